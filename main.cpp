@@ -19,10 +19,12 @@
 #include "./src/utils.cpp"
 #include "./src/sequentialVideoGenerator.cpp"
 #include "./src/paralleVideoGenerator.cpp"
+#include "./src/daemon.cpp"
+#include "./src/distributed.cpp"
 
 
 using namespace std;
-int main(int argc, char * argv[]) {
+int converterMain(int argc, char * argv[]) {
 
     if(cmdOptionExists(argv, argv+argc, "--help")){
         input_helper(argv[0]);
@@ -43,6 +45,8 @@ int main(int argc, char * argv[]) {
     int framerate = 30;
     bool hasAudio = false;
     string inputAudio = "default-audio.mp3";
+    string profile_path = profilePath();
+    ConverterOptions opts;
 
 
     if(cmdOptionExists(argv, argv+argc, "--tot_frames") )
@@ -59,18 +63,181 @@ int main(int argc, char * argv[]) {
         ffmpeg_thds =  atoi( getCmdOption(argv, argc + argv, "--ffmpeg_thds"));
     if(cmdOptionExists(argv, argv+argc, "--framerate"))
         framerate =  atoi( getCmdOption(argv, argc + argv, "--framerate"));
+    if(cmdOptionExists(argv, argv+argc, "--profile"))
+        profile_path = getCmdOption(argv, argc + argv, "--profile");
     if(cmdOptionExists(argv, argv+argc, "--audio")) {
         inputAudio = getCmdOption(argv, argc + argv, "--audio");
         hasAudio = true;
     }
+    if(cmdOptionExists(argv, argv+argc, "--transport"))
+        opts.transport = getCmdOption(argv, argc + argv, "--transport");
+    if(cmdOptionExists(argv, argv+argc, "--ring_mb"))
+        opts.ringSizeMB = atoi( getCmdOption(argv, argc + argv, "--ring_mb"));
+    if(cmdOptionExists(argv, argv+argc, "--renditions"))
+        opts.renditions = parseRenditions( getCmdOption(argv, argc + argv, "--renditions"));
+    if(cmdOptionExists(argv, argv+argc, "--proxy"))
+        opts.proxyHeight = atoi( getCmdOption(argv, argc + argv, "--proxy"));
+    if(cmdOptionExists(argv, argv+argc, "--proxy_fps"))
+        opts.proxyFps = atoi( getCmdOption(argv, argc + argv, "--proxy_fps"));
+    if(cmdOptionExists(argv, argv+argc, "--dedup"))
+        opts.dedup = true;
+    if(cmdOptionExists(argv, argv+argc, "--cache_dir"))
+        opts.cacheDir = getCmdOption(argv, argc + argv, "--cache_dir");
+    if(cmdOptionExists(argv, argv+argc, "--cache_mb"))
+        opts.cacheSizeMB = atoi( getCmdOption(argv, argc + argv, "--cache_mb"));
+    if(cmdOptionExists(argv, argv+argc, "--scene_cuts"))
+        opts.sceneCuts = true;
+    if(cmdOptionExists(argv, argv+argc, "--scene_tolerance"))
+        opts.sceneTolerance = atoi( getCmdOption(argv, argc + argv, "--scene_tolerance"));
+    if(cmdOptionExists(argv, argv+argc, "--scene_threshold"))
+        opts.sceneThreshold = atof( getCmdOption(argv, argc + argv, "--scene_threshold"));
+    if(cmdOptionExists(argv, argv+argc, "--cost_windows"))
+        opts.costWindows = true;
+    if(cmdOptionExists(argv, argv+argc, "--cost_sample"))
+        opts.costSample = atoi( getCmdOption(argv, argc + argv, "--cost_sample"));
+    if(cmdOptionExists(argv, argv+argc, "--target_size"))
+        opts.targetSizeMB = atoi( getCmdOption(argv, argc + argv, "--target_size"));
+    if(cmdOptionExists(argv, argv+argc, "--deadline"))
+        opts.deadlineSec = atoi( getCmdOption(argv, argc + argv, "--deadline"));
+    if(cmdOptionExists(argv, argv+argc, "--speculate"))
+        opts.speculateFactor = atof( getCmdOption(argv, argc + argv, "--speculate"));
+    if(cmdOptionExists(argv, argv+argc, "--tail_split"))
+        opts.tailSplit = true;
+    if(cmdOptionExists(argv, argv+argc, "--cpu_budget"))
+        opts.cpuBudget = atoi( getCmdOption(argv, argc + argv, "--cpu_budget"));
+    if(cmdOptionExists(argv, argv+argc, "--placement"))
+        opts.placement = true;
+    if(cmdOptionExists(argv, argv+argc, "--placement_report"))
+        opts.placementReport = getCmdOption(argv, argc + argv, "--placement_report");
+    if(cmdOptionExists(argv, argv+argc, "--background"))
+        opts.background = true;
+    if(cmdOptionExists(argv, argv+argc, "--mem_budget"))
+        opts.memBudgetMB = atol( getCmdOption(argv, argc + argv, "--mem_budget"));
+    if(cmdOptionExists(argv, argv+argc, "--resume"))
+        opts.resume = true;
+    if(cmdOptionExists(argv, argv+argc, "--retries"))
+        opts.retries = atoi( getCmdOption(argv, argc + argv, "--retries"));
+    if(cmdOptionExists(argv, argv+argc, "--nodes")) {
+        std::istringstream nodes(getCmdOption(argv, argc + argv, "--nodes"));
+        string node;
+        while(getline(nodes, node, ','))
+            if(!node.empty())
+                opts.nodes.push_back(node);
+    }
+    if(cmdOptionExists(argv, argv+argc, "--ship_frames"))
+        opts.shipFrames = true;
+    if(cmdOptionExists(argv, argv+argc, "--locality"))
+        opts.localityManifest = getCmdOption(argv, argc + argv, "--locality");
+    if(cmdOptionExists(argv, argv+argc, "--cmaf"))
+        opts.cmaf = true;
+    if(cmdOptionExists(argv, argv+argc, "--cmaf_gop"))
+        opts.cmafGop = atoi( getCmdOption(argv, argc + argv, "--cmaf_gop"));
+    if(cmdOptionExists(argv, argv+argc, "--live"))
+        opts.liveTarget = getCmdOption(argv, argc + argv, "--live");
+    if(cmdOptionExists(argv, argv+argc, "--live_buffer"))
+        opts.liveBufferMB = atol( getCmdOption(argv, argc + argv, "--live_buffer"));
+    if(opts.liveTarget == "-")
+        liveStream.takeStdout();
+    if(cmdOptionExists(argv, argv+argc, "--tmp_ram"))
+        opts.tmpRamMB = atol( getCmdOption(argv, argc + argv, "--tmp_ram"));
+
+    if(opts.targetSizeMB > 0 && (re_encode || !opts.renditions.empty())) {
+        printf(" --- Target size is only supported for a single output without re-encoding, ignored\n");
+        opts.targetSizeMB = 0;
+    }
+    // the windows of a streaming output are published as they are, never merged nor encoded again
+    if(opts.cmaf && (re_encode || opts.targetSizeMB > 0)) {
+        printf(" --- Re-encoding and target size are not supported with --cmaf, ignored\n");
+        re_encode = false;
+        opts.targetSizeMB = 0;
+    }
+    // the encoder nodes produce plain segments
+    if(opts.cmaf && (!opts.nodes.empty() || !opts.localityManifest.empty())) {
+        printf(" --- Encoder nodes are not supported with --cmaf, the windows are encoded locally\n");
+        opts.nodes.clear();
+        opts.localityManifest.clear();
+    }
+    // the windows of the live stream are the ones of the first pass
+    if(!opts.liveTarget.empty() && (re_encode || opts.targetSizeMB > 0)) {
+        printf(" --- The live stream is not supported with re-encoding or target size, disabled\n");
+        opts.liveTarget.clear();
+    }
+    // the reduce tree of re-encoding pairs exactly one window per worker
+    if(re_encode && opts.costWindows) {
+        printf(" --- Cost sized windows are not supported with re-encoding, using fixed windows\n");
+        opts.costWindows = false;
+    }
+    // nor windows cut at the frame ranges of the render nodes
+    if(re_encode && !opts.localityManifest.empty()) {
+        printf(" --- Locality is not supported with re-encoding, the windows are encoded locally\n");
+        opts.localityManifest.clear();
+    }
+    // the frames of a locality job live on the render nodes, the coordinator only sees their names
+    if(!opts.localityManifest.empty() && (opts.dedup || opts.sceneCuts || opts.costWindows || !opts.cacheDir.empty())) {
+        printf(" --- Frame content is not available with --locality: dedup, scene cuts, cost windows and cache disabled\n");
+        opts.dedup = opts.sceneCuts = opts.costWindows = false;
+        opts.cacheDir.clear();
+    }
+    // the encoder nodes read the frame files, or get them with the request
+    if((!opts.nodes.empty() || !opts.localityManifest.empty()) && opts.transport == "pipe") {
+        printf(" --- The pipe transport is local, encoder nodes read the frame files\n");
+        opts.transport = "files";
+    }
+    if(re_encode && opts.tailSplit) {
+        printf(" --- Tail splitting is not supported with re-encoding, ignored\n");
+        opts.tailSplit = false;
+    }
 
 
     string input_path = sanitize_path(argv[1]);
     string filename = argv[2];
     string output_path = argv[3]; //sanitize_path(argv[2]);
 
+    // under a given tmp location the job gets a directory of its own, removed once it completes
+    if(cmdOptionExists(argv, argv+argc, "--tmp_dir"))
+        opts.tmpDir = sanitize_path(getCmdOption(argv, argc + argv, "--tmp_dir")) + "iol_" +
+                      output_path.substr(0, output_path.rfind('.')) + "/";
+    if(cmdOptionExists(argv, argv+argc, "--output_dir"))
+        opts.outputDir = sanitize_path(getCmdOption(argv, argc + argv, "--output_dir"));
+
+    // the machine profile fills the split between workers and ffmpeg threads left to the converter
+    string preset = re_encode ? "veryslow" : "medium";
+    bool auto_par = cmdOptionExists(argv, argv+argc, "--par") && par_degree <= 0;
+    if(auto_par) {
+        par_degree = thread::hardware_concurrency();
+        // the partial outputs of a re-encode are merged in pairs
+        while(re_encode && (par_degree & (par_degree - 1)) != 0)
+            par_degree &= par_degree - 1;
+    }
+    if(!cmdOptionExists(argv, argv+argc, "--calibrate") && cmdOptionExists(argv, argv+argc, "--par") &&
+       (auto_par || ffmpeg_thds == 0)) {
+        MachineProfile profile = machineProfile(input_path, filename, preset);
+        if(profile.load(profile_path)) {
+            pair<int, int> best = profile.best(auto_par ? 0 : par_degree, re_encode);
+            if(auto_par)
+                par_degree = best.first;
+            ffmpeg_thds = best.second;
+            printf(" --- Machine profile %s/%s: %d workers x %d ffmpeg threads\n",
+                   profile.resolution.empty() ? "any" : profile.resolution.c_str(), preset.c_str(), par_degree, ffmpeg_thds);
+        }
+    }
+
+    int ret = 0;
     printf("\n ------------------------------------------------------------------ \n");
-    if(cmdOptionExists(argv, argv+argc, "--seq")) {
+    if(cmdOptionExists(argv, argv+argc, "--calibrate")) {
+
+        // measure the machine and save its profile
+        MachineProfile profile = machineProfile(input_path, filename, preset);
+        if(calibrate(profile, input_path, filename, framerate, opts.tmpDir)) {
+            pair<int, int> best = profile.best(0);
+            printf(" --- Best setting: --par %d --ffmpeg_thds %d\n", best.first, best.second);
+            if(profile.save(profile_path))
+                printf(" --- Machine profile saved to %s\n", profile_path.c_str());
+        }
+        deleteDir(opts.tmpDir);
+
+    }
+    else if(cmdOptionExists(argv, argv+argc, "--seq")) {
 
         // start sequential program
         seqImgToVideoConverter(
@@ -84,7 +251,9 @@ int main(int argc, char * argv[]) {
                 re_encode,
                 framerate,
                 hasAudio,
-                inputAudio
+                inputAudio,
+                opts.tmpDir,
+                opts.outputDir
 
         );
 
@@ -92,7 +261,7 @@ int main(int argc, char * argv[]) {
     else if(cmdOptionExists(argv, argv+argc, "--par")) {
 
         // start parallel program
-        parallelConverter(
+        ret = parallelConverter(
                 input_path,
                 filename,
                 output_path,
@@ -104,12 +273,27 @@ int main(int argc, char * argv[]) {
                 ffmpeg_thds,
                 framerate,
                 hasAudio,
-                inputAudio
+                inputAudio,
+                opts
 
         );
     }
 
     printf(" -------------------------------------------------------------------- \n");
-    return 0;
+    return ret < 0 ? 1 : 0;
     
-}
\ No newline at end of file
+}
+
+int main(int argc, char * argv[]) {
+
+    if(cmdOptionExists(argv, argv+argc, "--daemon"))
+        return runDaemon(argc, argv);
+    if(cmdOptionExists(argv, argv+argc, "--submit") || cmdOptionExists(argv, argv+argc, "--status"))
+        return runClient(argc, argv);
+    if(cmdOptionExists(argv, argv+argc, "--encoder_node"))
+        return runEncoderNode(argc, argv);
+    if(argc > 1 && string(argv[1]) == "--remote_encode")
+        return runRemoteEncode(argc, argv);
+
+    return converterMain(argc, argv);
+}
@@ -0,0 +1,348 @@
+/**
+ *  @file    autoTuner.cpp
+ *  @author  Biniam Abrha Nigusse
+ *  @date    19/10/2026
+ *
+ *  @brief calibration of the split between workers and ffmpeg threads with short sample
+ *  encodes, saved as a machine profile keyed by CPU model, resolution class and preset
+ *
+ */
+
+#include <map>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <chrono>
+#include <fstream>
+
+#define CALIBRATION_FRAMES  60
+#define CALIBRATION_THREADS 16
+
+
+/**
+ *  @name cpuModel
+ *  @brief model name of the processor, from /proc/cpuinfo
+ *  @return string, "unknown" if it cannot be read
+ *
+ */
+string cpuModel() {
+    ifstream cpuinfo("/proc/cpuinfo");
+    string line;
+    while(getline(cpuinfo, line)) {
+        if(line.compare(0, 10, "model name") != 0)
+            continue;
+        string::size_type p = line.find(':');
+        if(p != string::npos && p + 2 <= line.size())
+            return line.substr(p + 2);
+    }
+    return "unknown";
+}
+
+/**
+ *  @name frameHeight
+ *  @brief height of an image, read from the IHDR chunk of a png or with ffprobe
+ *  @return integer, 0 if unknown
+ *
+ */
+int frameHeight(const string &path) {
+    unsigned char header[24];
+    ifstream file(path, ios::binary);
+    if(file.read((char *) header, sizeof(header)) && memcmp(header + 12, "IHDR", 4) == 0)
+        return (header[20] << 24) | (header[21] << 16) | (header[22] << 8) | header[23];
+
+    string out = captureOutput({"ffprobe", "-v", "error", "-select_streams", "v:0", "-show_entries", "stream=height",
+                                "-of", "csv=p=0", path}, 64);
+    return max(0, atoi(out.c_str()));
+}
+
+/**
+ *  @name resolutionClass
+ *  @brief class of a frame height, encoders scale alike within a class
+ *  @return string, empty if the height is unknown
+ *
+ */
+string resolutionClass(int height) {
+    if(height <= 0) return "";
+    for(int h : {480, 720, 1080, 1440})
+        if(height <= h)
+            return to_string(h) + "p";
+    return "2160p";
+}
+
+/**
+ *  @name firstFrame
+ *  @brief first image of the input directory in frame order
+ *  @return frame index, -1 if the directory has no image
+ *
+ */
+int firstFrame(const string &inputPath, int &available) {
+    stringVec names;
+    read_directory(inputPath, names, -1);
+    available = names.size();
+    int first = -1;
+    for(auto &name : names) {
+        int fno = FrameWindows::name2no(name);
+        if(first < 0 || fno < first)
+            first = fno;
+    }
+    return first;
+}
+
+/**
+ *  @name MachineProfile
+ *  @brief throughput (frames/s) measured on a grid of (workers, threads per encoder) and an
+ *  Amdahl model of one encoder fitted on it, 1/fps(t) = a + b/t. The points off the grid are
+ *  predicted with the model, scaled by the contention measured between concurrent encoders.
+ *
+*/
+class MachineProfile {
+public:
+    string cpu;
+    string resolution;
+    string preset;
+    int cores = 1;
+    double a = 0.0;
+    double b = 0.0;
+    double contention = 1.0;
+    map<pair<int, int>, double> measured;
+
+    /**
+     *  @name fit
+     *  @brief fit the model on the measured points
+     *
+     */
+    void fit() {
+        // least squares of 1/fps over 1/t on the single worker points
+        double sx = 0, sy = 0, sxx = 0, sxy = 0;
+        int n = 0;
+        for(auto &m : measured) {
+            if(m.first.first != 1 || m.second <= 0) continue;
+            double x = 1.0 / m.first.second, y = 1.0 / m.second;
+            sx += x; sy += y; sxx += x * x; sxy += x * y;
+            n++;
+        }
+        double det = n * sxx - sx * sx;
+        if(n >= 2 && fabs(det) > 1e-12) {
+            b = max(0.0, (n * sxy - sx * sy) / det);
+            a = max(0.0, (sy - b * sx) / n);
+        }
+        else if(n == 1) {
+            a = sy;
+            b = 0.0;
+        }
+
+        // median ratio between the measured and the predicted throughput of concurrent encoders
+        vector<double> ratios;
+        contention = 1.0;
+        for(auto &m : measured) {
+            if(m.first.first == 1) continue;
+            double p = model(m.first.first, m.first.second);
+            if(p > 0 && m.second > 0)
+                ratios.push_back(m.second / p);
+        }
+        if(!ratios.empty()) {
+            sort(ratios.begin(), ratios.end());
+            contention = ratios[ratios.size() / 2];
+        }
+    }
+
+    /**
+     *  @name throughput
+     *  @brief frames per second of a setting, measured or predicted
+     *  @return double value
+     *
+     */
+    double throughput(int workers, int threads) const {
+        auto it = measured.find({workers, threads});
+        if(it != measured.end())
+            return it->second;
+        return model(workers, threads) * contention;
+    }
+
+    /**
+     *  @name best
+     *  @brief best (workers, threads) setting, workers fixed unless 0, a power of two if
+     *  powerOfTwo is set (the merge tree of the re-encoded windows)
+     *  @return pair of integers
+     *
+     */
+    pair<int, int> best(int workers, bool powerOfTwo = false) const {
+        pair<int, int> choice = {max(1, workers), 1};
+        double bestFps = -1.0;
+        for(int w = 1; w <= cores; w++) {
+            if(workers > 0 && w != workers) continue;
+            if(workers == 0 && powerOfTwo && (w & (w - 1)) != 0) continue;
+            for(int t = 1; t <= CALIBRATION_THREADS && w * t <= 2 * cores; t++) {
+                double fps = throughput(w, t);
+                if(fps > bestFps * 1.01) {
+                    bestFps = fps;
+                    choice = {w, t};
+                }
+            }
+        }
+        return choice;
+    }
+
+    /**
+     *  @name load
+     *  @brief read the profile of this machine from path, any resolution class matches an
+     *  empty one
+     *  @return boolean value, true if found
+     *
+     */
+    bool load(const string &path) {
+        ifstream file(path);
+        string line;
+        bool found = false;
+        while(getline(file, line)) {
+            vector<string> fields;
+            std::istringstream in(line);
+            string field;
+            while(getline(in, field, '\t'))
+                fields.push_back(field);
+            if(fields.size() != 8 || fields[0] != cpu || fields[2] != preset)
+                continue;
+            if(!resolution.empty() && fields[1] != resolution)
+                continue;
+            if(found && resolution.empty())
+                continue;
+
+            cores = atoi(fields[3].c_str());
+            a = atof(fields[4].c_str());
+            b = atof(fields[5].c_str());
+            contention = atof(fields[6].c_str());
+            measured.clear();
+            std::istringstream points(fields[7]);
+            string point;
+            while(getline(points, point, ',')) {
+                int w, t;
+                double fps;
+                if(sscanf(point.c_str(), "%dx%d=%lf", &w, &t, &fps) == 3)
+                    measured[{w, t}] = fps;
+            }
+            found = true;
+        }
+        return found;
+    }
+
+    /**
+     *  @name save
+     *  @brief write the profile to path, replacing the previous one with the same key
+     *  @return boolean value
+     *
+     */
+    bool save(const string &path) const {
+        stringVec lines;
+        {
+            ifstream file(path);
+            string line;
+            string key = cpu + "\t" + resolution + "\t" + preset + "\t";
+            while(getline(file, line))
+                if(line.compare(0, key.size(), key) != 0)
+                    lines.push_back(line);
+        }
+
+        std::ostringstream profile;
+        profile.precision(9);
+        profile << cpu << "\t" << resolution << "\t" << preset << "\t" << cores << "\t"
+                << a << "\t" << b << "\t" << contention << "\t";
+        for(auto &m : measured)
+            profile << (m.first == measured.begin()->first ? "" : ",") << m.first.first << "x" << m.first.second << "=" << m.second;
+        lines.push_back(profile.str());
+
+        ofstream file(path, ios::trunc);
+        for(auto &line : lines)
+            file << line << "\n";
+        return bool(file);
+    }
+
+private:
+    double model(int workers, int threads) const {
+        double single = a + b / threads;
+        if(single <= 0)
+            return 0.0;
+        return workers / single * min(1.0, double(cores) / (workers * threads));
+    }
+};
+
+/**
+ *  @name profilePath
+ *  @brief default location of the machine profiles
+ *  @return string
+ *
+ */
+string profilePath() {
+    const char *home = getenv("HOME");
+    return string(home ? home : ".") + "/.iol_machine_profiles";
+}
+
+/**
+ *  @name machineProfile
+ *  @brief profile key of this machine for an input directory and a preset, the resolution
+ *  class is left empty while the directory has no frame
+ *  @return MachineProfile without measurements
+ *
+ */
+MachineProfile machineProfile(const string &inputPath, const string &filename, const string &preset) {
+    MachineProfile profile;
+    profile.cpu = cpuModel();
+    profile.preset = preset;
+    profile.cores = max(1, int(thread::hardware_concurrency()));
+    int available;
+    int first = firstFrame(inputPath, available);
+    if(first >= 0)
+        profile.resolution = resolutionClass(frameHeight(frameFilename(inputPath + filename, first)));
+    return profile;
+}
+
+/**
+ *  @name calibrate
+ *  @brief encode the first frames of the input directory concurrently with every setting
+ *  of the grid (powers of two, workers * threads up to twice the cores) and fit the model
+ *  @return boolean value, false if the directory has not enough frames
+ *
+ */
+bool calibrate(MachineProfile &profile, const string &inputPath, const string &filename, int framerate, const string &tmpDir) {
+    int available;
+    int first = firstFrame(inputPath, available);
+    int frames = min(CALIBRATION_FRAMES, available);
+    if(first < 0 || frames < 2) {
+        cerr << "Calibration needs the frames in " << inputPath << endl;
+        return false;
+    }
+
+    fs::create_directories(tmpDir);
+    string inputFile = inputPath + filename;
+
+    for(int w = 1; w <= profile.cores; w *= 2) {
+        for(int t = 1; t <= CALIBRATION_THREADS && w * t <= 2 * profile.cores; t *= 2) {
+            auto start = std::chrono::high_resolution_clock::now();
+            vector<pid_t> pids;
+            stringVec outputs;
+            for(int i = 0; i < w; i++) {
+                outputs.push_back(tmpDir + "calibrate_" + to_string(i) + ".mp4");
+                std::error_code ec;
+                fs::remove(outputs.back(), ec);
+                pids.push_back(spawnFFmpeg(imageEncoderArgs(inputFile, outputs.back(), to_string(first), to_string(framerate),
+                                                            frames, to_string(t), profile.preset, -1)));
+            }
+            bool ok = true;
+            for(pid_t pid : pids)
+                ok = waitChildProc(pid) == 0 && ok;
+            auto elapsed = std::chrono::high_resolution_clock::now() - start;
+            double sec = std::chrono::duration_cast<std::chrono::milliseconds>(elapsed).count() / 1000.0;
+            for(auto &output : outputs) {
+                std::error_code ec;
+                fs::remove(output, ec);
+            }
+            if(!ok || sec <= 0)
+                continue;
+
+            profile.measured[{w, t}] = w * frames / sec;
+            printf(" --- Calibration: %d workers x %d threads: %.1f frames/s\n", w, t, w * frames / sec);
+        }
+    }
+
+    profile.fit();
+    return !profile.measured.empty();
+}
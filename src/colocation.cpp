@@ -0,0 +1,119 @@
+/**
+ *  @file    colocation.cpp
+ *  @author  Biniam Abrha Nigusse
+ *  @date    19/10/2026
+ *
+ *  @brief co-location with other workloads: the converter runs at idle priority and its
+ *  encoder parallelism follows the cpu pressure of the machine
+ *
+ */
+
+#include <sched.h>
+#include <sys/resource.h>
+#include <atomic>
+#include <fstream>
+
+#define PRESSURE_FILE        "/proc/pressure/cpu"
+#define PRESSURE_HIGH        10.0   // % of time tasks waited for a cpu, shrink above
+#define PRESSURE_LOW         2.0    // grow below
+#define PRESSURE_INTERVAL_MS 2000
+
+
+/**
+ *  @name lowerPriority
+ *  @brief move the calling thread to SCHED_IDLE with the lowest nice value, the threads and
+ *  the processes it creates afterwards inherit both
+ *  @return boolean value, false if the idle policy is not available
+ *
+ */
+bool lowerPriority() {
+    setpriority(PRIO_PROCESS, 0, 19);
+    struct sched_param param = {};
+    return sched_setscheduler(0, SCHED_IDLE, &param) == 0;
+}
+
+/**
+ *  @name cpuPressure
+ *  @brief share of the last 10 seconds some runnable task waited for a cpu (PSI)
+ *  @return percentage, -1 if the kernel does not report it
+ *
+ */
+double cpuPressure() {
+    ifstream psi(PRESSURE_FILE);
+    string kind, avg10;
+    while(psi >> kind >> avg10) {
+        psi.ignore(256, '\n');
+        if(kind == "some" && avg10.compare(0, 6, "avg10=") == 0)
+            return atof(avg10.c_str() + 6);
+    }
+    return -1.0;
+}
+
+/**
+ *  @name PressureGovernor
+ *  @brief resizes the cpu token pool from the cpu pressure: the pool starts at half its
+ *  maximum, shrinks by a quarter while other tasks wait for cpus and grows by a quarter
+ *  while the cpus are free
+ *
+*/
+class PressureGovernor {
+private:
+    std::thread governor;
+    std::mutex mtx;
+    std::condition_variable cv;
+    bool running = false;
+    std::atomic<int> minTokens{0};
+    std::atomic<int> maxTokensSeen{0};
+
+public:
+
+    ~PressureGovernor() { stop(); }
+
+    /**
+     *  @name start
+     *  @brief start adapting pool between 1 and maxTokens tokens
+     *  @return boolean value, false if the cpu pressure is not available
+     *
+     */
+    bool start(CpuTokens &pool, int maxTokens) {
+        if(cpuPressure() < 0)
+            return false;
+        running = true;
+        pool.resize(max(1, maxTokens / 2));
+        minTokens = maxTokensSeen = pool.size();
+        governor = std::thread([this, &pool, maxTokens] {
+            std::unique_lock<std::mutex> lock(mtx);
+            while(!cv.wait_for(lock, std::chrono::milliseconds(PRESSURE_INTERVAL_MS), [this] { return !running; })) {
+                double pressure = cpuPressure();
+                int tokens = pool.size();
+                if(pressure > PRESSURE_HIGH)
+                    tokens = max(1, tokens - max(1, tokens / 4));
+                else if(pressure >= 0 && pressure < PRESSURE_LOW)
+                    tokens = min(maxTokens, tokens + max(1, tokens / 4));
+                if(tokens != pool.size()) {
+                    pool.resize(tokens);
+                    minTokens = min(int(minTokens), tokens);
+                    maxTokensSeen = max(int(maxTokensSeen), tokens);
+                }
+            }
+        });
+        return true;
+    }
+
+    void stop() {
+        {
+            std::lock_guard<std::mutex> lock(mtx);
+            running = false;
+        }
+        cv.notify_all();
+        if(governor.joinable())
+            governor.join();
+    }
+
+    void print() const {
+        if(maxTokensSeen == 0) return;
+        cout << " ****** Encoder threads under cpu pressure: between " << minTokens << " and " << maxTokensSeen << "\n";
+    }
+};
+
+PressureGovernor pressureGovernor;
@@ -0,0 +1,126 @@
+/**
+ *  @file    costModel.cpp
+ *  @author  Biniam Abrha Nigusse
+ *  @date    19/10/2026
+ *
+ *  @brief estimate of the encode cost of a window from the complexity of its frames,
+ *  refined with the encode times measured by the workers
+ *
+ */
+
+#include <map>
+#include <mutex>
+#include <cmath>
+
+
+/**
+ *  @name thumbnailComplexity
+ *  @brief complexity of a frame: mean spatial gradient of its luma thumbnail plus the mean
+ *  difference with the previous analysed thumbnail
+ *  @return double value, at least 1
+ *
+ */
+double thumbnailComplexity(const vector<unsigned char> &cur, const vector<unsigned char> &prev) {
+    if(cur.size() != THUMB_WIDTH * THUMB_HEIGHT)
+        return 1.0;
+
+    double spatial = 0.0;
+    for(int y = 0; y < THUMB_HEIGHT - 1; y++) {
+        for(int x = 0; x < THUMB_WIDTH - 1; x++) {
+            int p = cur[y * THUMB_WIDTH + x];
+            spatial += abs(p - cur[y * THUMB_WIDTH + x + 1]) + abs(p - cur[(y + 1) * THUMB_WIDTH + x]);
+        }
+    }
+    spatial /= (THUMB_WIDTH - 1) * (THUMB_HEIGHT - 1);
+
+    double temporal = 0.0;
+    if(prev.size() == cur.size()) {
+        for(size_t i = 0; i < cur.size(); i++)
+            temporal += abs(int(cur[i]) - int(prev[i]));
+        temporal /= cur.size();
+    }
+
+    return 1.0 + spatial + temporal;
+}
+
+/**
+ *  @name CostModel
+ *  @brief linear model of the encode time of a window, a * (sum of frame complexities) + b * frames.
+ *  Only the ratio of the two terms drives the window sizes, it is fitted with least squares
+ *  on the measured encode times once enough windows completed.
+ *
+*/
+class CostModel {
+private:
+    std::mutex mtx;
+    double a = 1.0;
+    double b = 0.0;
+    // normal equations of the least squares fit
+    double sxx = 0, sxn = 0, snn = 0, sxt = 0, snt = 0;
+    int observations = 0;
+    std::map<int, double> windowComplexity;
+
+public:
+
+    /**
+     *  @name cost
+     *  @brief estimated encode cost of a window
+     *  @return double value
+     *
+     */
+    double cost(double sumComplexity, int frames) {
+        std::lock_guard<std::mutex> lock(mtx);
+        return a * sumComplexity + b * frames;
+    }
+
+    // remember the complexity of a dispatched window, matched later with its encode time
+    void recordWindow(int firstFrame, double sumComplexity) {
+        std::lock_guard<std::mutex> lock(mtx);
+        windowComplexity[firstFrame] = sumComplexity;
+    }
+
+    // a window split before its encode no longer matches its complexity
+    void dropWindow(int firstFrame) {
+        std::lock_guard<std::mutex> lock(mtx);
+        windowComplexity.erase(firstFrame);
+    }
+
+    /**
+     *  @name observe
+     *  @brief feed back the measured encode time of a window and refit the model
+     *
+     */
+    void observe(int firstFrame, int frames, long encodeMs) {
+        std::lock_guard<std::mutex> lock(mtx);
+        auto it = windowComplexity.find(firstFrame);
+        if(it == windowComplexity.end() || encodeMs <= 0)
+            return;
+
+        double x = it->second, n = frames, t = encodeMs;
+        windowComplexity.erase(it);
+        sxx += x * x; sxn += x * n; snn += n * n;
+        sxt += x * t; snt += n * t;
+        observations++;
+
+        double det = sxx * snn - sxn * sxn;
+        if(observations < 2 || fabs(det) < 1e-9 * sxx * snn)
+            return;
+
+        double fa = (sxt * snn - snt * sxn) / det;
+        double fb = (snt * sxx - sxt * sxn) / det;
+        // keep the previous model if the fit is not physical
+        if(fa > 0 && fb >= 0) {
+            a = fa;
+            b = fb;
+        }
+    }
+
+    void print() {
+        std::lock_guard<std::mutex> lock(mtx);
+        if(observations == 0) return;
+        cout << " ****** Cost model (ms) = " << a << " * complexity + " << b << " * frames, fitted on "
+             << observations << " windows\n";
+    }
+};
+
+CostModel costModel;
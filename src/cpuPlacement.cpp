@@ -0,0 +1,229 @@
+/**
+ *  @file    cpuPlacement.cpp
+ *  @author  Biniam Abrha Nigusse
+ *  @date    19/10/2026
+ *
+ *  @brief placement of the workers and of their encoders on the cores of one NUMA node,
+ *  with the memory bound to that node, and of the emitter on a core of its own
+ *
+ */
+
+#include <sched.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#include <fstream>
+#include <map>
+
+#ifndef MPOL_BIND
+#define MPOL_BIND 2
+#endif
+
+
+/**
+ *  @name parseCpuList
+ *  @brief expand a kernel cpu list such as 0-3,8-11
+ *  @return vector of cpu numbers
+ *
+ */
+vector<int> parseCpuList(const string &list) {
+    vector<int> cpus;
+    std::istringstream in(list);
+    string range;
+    while(getline(in, range, ',')) {
+        int first, last;
+        int n = sscanf(range.c_str(), "%d-%d", &first, &last);
+        if(n == 1)
+            last = first;
+        if(n >= 1)
+            for(int cpu = first; cpu <= last; cpu++)
+                cpus.push_back(cpu);
+    }
+    return cpus;
+}
+
+/**
+ *  @name numaNodes
+ *  @brief cpus of every NUMA node, from /sys/devices/system/node. A machine without the
+ *  information is a single node with all its cpus.
+ *  @return map of node number to its cpus
+ *
+ */
+map<int, vector<int>> numaNodes() {
+    map<int, vector<int>> nodes;
+    std::error_code ec;
+    for(auto &entry : fs::directory_iterator("/sys/devices/system/node", ec)) {
+        string name = entry.path().filename().string();
+        if(name.compare(0, 4, "node") != 0 || name.size() == 4 || !isdigit(name[4]))
+            continue;
+        ifstream cpulist(entry.path() / "cpulist");
+        string list;
+        if(getline(cpulist, list)) {
+            vector<int> cpus = parseCpuList(list);
+            if(!cpus.empty())
+                nodes[atoi(name.c_str() + 4)] = cpus;
+        }
+    }
+
+    if(nodes.empty())
+        for(unsigned cpu = 0; cpu < thread::hardware_concurrency(); cpu++)
+            nodes[0].push_back(cpu);
+    return nodes;
+}
+
+/**
+ *  @name CpuPlacement
+ *  @brief the workers are spread round robin over the NUMA nodes and share the cores of
+ *  their node. A worker binds its own thread, the encoders it forks inherit the affinity and
+ *  the memory policy. The first core is kept for the emitter when the machine has more
+ *  cores than workers.
+ *
+*/
+class CpuPlacement {
+private:
+    bool enabled = false;
+    int emitterCpu = -1;
+    vector<int> workerNode;
+    vector<vector<int>> workerCpus;
+    bool multiNode = false;
+
+public:
+
+    /**
+     *  @name start
+     *  @brief compute the placement of numWorkers workers
+     *
+     */
+    void start(int numWorkers) {
+        map<int, vector<int>> nodes = numaNodes();
+        multiNode = nodes.size() > 1;
+
+        size_t totalCpus = 0;
+        for(auto &node : nodes)
+            totalCpus += node.second.size();
+        if(totalCpus > size_t(numWorkers)) {
+            emitterCpu = nodes.begin()->second.front();
+            nodes.begin()->second.erase(nodes.begin()->second.begin());
+        }
+
+        vector<int> nodeIds;
+        for(auto &node : nodes)
+            nodeIds.push_back(node.first);
+
+        workerNode.assign(numWorkers, 0);
+        workerCpus.assign(numWorkers, {});
+        map<int, int> perNode;
+        for(int w = 0; w < numWorkers; w++) {
+            workerNode[w] = nodeIds[w % nodeIds.size()];
+            perNode[workerNode[w]]++;
+        }
+
+        // the cores of a node are split between its workers, shared if they are fewer
+        map<int, int> slot;
+        for(int w = 0; w < numWorkers; w++) {
+            const vector<int> &cpus = nodes[workerNode[w]];
+            int m = perNode[workerNode[w]], k = slot[workerNode[w]]++;
+            int c = cpus.size();
+            if(c >= m)
+                workerCpus[w].assign(cpus.begin() + size_t(k) * c / m, cpus.begin() + size_t(k + 1) * c / m);
+            else
+                workerCpus[w].push_back(cpus[k % c]);
+        }
+        enabled = true;
+    }
+
+    bool isEnabled() const { return enabled; }
+
+    /**
+     *  @name bindEmitter
+     *  @brief keep the calling thread, the emitter, on its own core
+     *
+     */
+    void bindEmitter() const {
+        if(!enabled || emitterCpu < 0)
+            return;
+        cpu_set_t set;
+        CPU_ZERO(&set);
+        CPU_SET(emitterCpu, &set);
+        sched_setaffinity(0, sizeof(set), &set);
+    }
+
+    /**
+     *  @name bindWorker
+     *  @brief bind the calling thread and the processes it spawns to the cores and the memory
+     *  of the node of a worker
+     *
+     */
+    void bindWorker(int worker) const {
+        if(!enabled || worker >= int(workerCpus.size()))
+            return;
+        cpu_set_t set;
+        CPU_ZERO(&set);
+        for(int cpu : workerCpus[worker])
+            CPU_SET(cpu, &set);
+        if(sched_setaffinity(0, sizeof(set), &set) != 0)
+            perror("sched_setaffinity");
+
+        if(multiNode && workerNode[worker] < int(8 * sizeof(unsigned long))) {
+            unsigned long mask = 1UL << workerNode[worker];
+            if(syscall(SYS_set_mempolicy, MPOL_BIND, &mask, 8 * sizeof(mask)) != 0)
+                perror("set_mempolicy");
+        }
+    }
+
+    string describe(int worker) const {
+        if(!enabled || worker >= int(workerCpus.size()))
+            return "";
+        string cpus;
+        for(int cpu : workerCpus[worker])
+            cpus += (cpus.empty() ? "" : ",") + to_string(cpu);
+        return "node " + to_string(workerNode[worker]) + " cpus " + cpus;
+    }
+};
+
+CpuPlacement cpuPlacement;
+
+/**
+ *  @name placementReport
+ *  @brief append the throughput of the job to a csv file and compare the runs with and
+ *  without placement of the same configuration
+ *
+ */
+void placementReport(const string &path, bool placement, int workers, int threads, int frames, long completionMs) {
+    double fps = completionMs > 0 ? frames * 1000.0 / completionMs : 0.0;
+    bool exists = fs::exists(path);
+    {
+        ofstream csv(path, ios::app);
+        if(!csv.is_open()) {
+            cerr << "Cannot write the placement report " << path << endl;
+            return;
+        }
+        if(!exists)
+            csv << "placement,workers,threads,frames,completion_ms,fps\n";
+        csv << (placement ? "on" : "off") << "," << workers << "," << threads << "," << frames << ","
+            << completionMs << "," << fps << "\n";
+    }
+
+    // mean throughput of the runs of this configuration, with and without placement
+    double sum[2] = {0, 0};
+    int runs[2] = {0, 0};
+    ifstream csv(path);
+    string line;
+    getline(csv, line);
+    while(getline(csv, line)) {
+        char mode[8];
+        int w, t, f;
+        long ms;
+        double rowFps;
+        if(sscanf(line.c_str(), "%7[^,],%d,%d,%d,%ld,%lf", mode, &w, &t, &f, &ms, &rowFps) != 6)
+            continue;
+        if(w != workers || t != threads || f != frames)
+            continue;
+        int on = string(mode) == "on";
+        sum[on] += rowFps;
+        runs[on]++;
+    }
+
+    cout << " ****** Throughput (frames/s) with placement: "
+         << (runs[1] ? to_string(sum[1] / runs[1]) : "-") << " (" << runs[1] << " runs), without: "
+         << (runs[0] ? to_string(sum[0] / runs[0]) : "-") << " (" << runs[0] << " runs)\n";
+}
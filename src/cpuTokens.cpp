@@ -0,0 +1,199 @@
+/**
+ *  @file    cpuTokens.cpp
+ *  @author  Biniam Abrha Nigusse
+ *  @date    19/10/2026
+ *
+ *  @brief jobserver-like pool of cpu tokens shared by all the ffmpeg processes of a job,
+ *  one token per thread, so that the runnable threads stay within the cores
+ *
+ */
+
+#include <mutex>
+#include <condition_variable>
+#include <chrono>
+#include <algorithm>
+#include <cerrno>
+#include <fcntl.h>
+#include <unistd.h>
+
+
+/**
+ *  @name CpuTokens
+ *  @brief every encoder, merge or mux takes its threads from the pool before it is spawned
+ *  and gives them back once it exited. A process gets what is left, at least one token,
+ *  so the processes started later get the threads freed in the meantime. A disabled pool
+ *  grants every request. The jobs of a daemon share its pool through a pipe holding one
+ *  byte per token, as the make jobserver does.
+ *
+*/
+class CpuTokens {
+private:
+    std::mutex mtx;
+    std::condition_variable cv;
+    int total = 0;
+    int available = 0;
+    long waitedMs = 0;
+    int shortGrants = 0;
+    // pipe of the daemon, the second read end does not block
+    int sharedRead = -1;
+    int sharedWrite = -1;
+    int sharedPoll = -1;
+
+public:
+
+    /**
+     *  @name attachShared
+     *  @brief take the tokens from the pipe shared by the jobs of a daemon
+     *
+     */
+    void attachShared(int readFd, int writeFd) {
+        sharedRead = readFd;
+        sharedWrite = writeFd;
+        sharedPoll = open(("/proc/self/fd/" + to_string(readFd)).c_str(), O_RDONLY | O_NONBLOCK | O_CLOEXEC);
+    }
+
+    /**
+     *  @name start
+     *  @brief enable the pool with the given number of tokens
+     *
+     */
+    void start(int tokens) {
+        std::lock_guard<std::mutex> lock(mtx);
+        if(sharedRead >= 0)
+            return;
+        total = std::max(1, tokens);
+        available = total;
+    }
+
+    bool isEnabled() const { return total > 0 || sharedRead >= 0; }
+
+    /**
+     *  @name acquire
+     *  @brief take up to want tokens, waiting until at least least of them are free
+     *  @return number of tokens granted, 0 if the shared pool cannot be read: the caller
+     *  then runs a single thread of its own
+     *
+     */
+    int acquire(int want, int least = 1) {
+        want = std::max(1, want);
+        if(sharedRead >= 0)
+            return takeShared(want, true);
+        std::unique_lock<std::mutex> lock(mtx);
+        if(total == 0)
+            return want;
+
+        least = std::max(1, std::min({least, want, total}));
+        auto start = std::chrono::steady_clock::now();
+        cv.wait(lock, [&] { return available >= least; });
+        waitedMs += std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now() - start).count();
+
+        int granted = std::min(want, available);
+        available -= granted;
+        if(granted < want)
+            shortGrants++;
+        return granted;
+    }
+
+    /**
+     *  @name tryAcquire
+     *  @brief take up to want tokens without waiting
+     *  @return number of tokens granted, 0 if none is free
+     *
+     */
+    int tryAcquire(int want) {
+        want = std::max(1, want);
+        if(sharedRead >= 0)
+            return takeShared(want, false);
+        std::lock_guard<std::mutex> lock(mtx);
+        if(total == 0)
+            return want;
+
+        // a shrunk pool can have fewer than zero tokens left
+        int granted = std::max(0, std::min(want, available));
+        available -= granted;
+        return granted;
+    }
+
+    /**
+     *  @name resize
+     *  @brief change the size of the pool, the tokens in use above the new size are
+     *  absorbed as they are released
+     *
+     */
+    void resize(int tokens) {
+        std::lock_guard<std::mutex> lock(mtx);
+        if(total == 0)
+            return;
+        tokens = std::max(1, tokens);
+        available += tokens - total;
+        total = tokens;
+        cv.notify_all();
+    }
+
+    int size() {
+        std::lock_guard<std::mutex> lock(mtx);
+        return total;
+    }
+
+    void release(int tokens) {
+        if(tokens <= 0)
+            return;
+        if(sharedWrite >= 0) {
+            giveShared(tokens);
+            return;
+        }
+        std::lock_guard<std::mutex> lock(mtx);
+        if(total == 0)
+            return;
+        available = std::min(total, available + tokens);
+        cv.notify_all();
+    }
+
+    void print() {
+        std::lock_guard<std::mutex> lock(mtx);
+        if(!isEnabled()) return;
+        cout << " ****** CPU tokens: " << (sharedRead >= 0 ? "shared by the daemon" : to_string(total)) << ", processes started with fewer threads: " << shortGrants
+             << ", waiting for tokens (ms): " << waitedMs << "\n";
+    }
+private:
+
+    // a grant from the shared pool waits for a single token, several tokens taken one by one
+    // by different jobs could otherwise hold each other
+    int takeShared(int want, bool wait) {
+        char tokens[256];
+        want = std::min(want, int(sizeof(tokens)));
+        int got = 0;
+        auto start = std::chrono::steady_clock::now();
+        while(wait && got == 0) {
+            ssize_t n = read(sharedRead, tokens, 1);
+            if(n > 0)
+                got = n;
+            else if(n == 0 || errno != EINTR)
+                return 0;   // the daemon is gone, nothing to give back
+        }
+        if(got < want && sharedPoll >= 0) {
+            ssize_t n = read(sharedPoll, tokens, want - got);
+            if(n > 0)
+                got += n;
+        }
+
+        std::lock_guard<std::mutex> lock(mtx);
+        waitedMs += std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now() - start).count();
+        if(wait && got < want)
+            shortGrants++;
+        return got;
+    }
+
+    void giveShared(int tokens) {
+        char bytes[256] = {};
+        while(tokens > 0) {
+            ssize_t n = write(sharedWrite, bytes, std::min(tokens, int(sizeof(bytes))));
+            if(n > 0)
+                tokens -= n;
+            else if(errno != EINTR)
+                break;
+        }
+    }
+};
+
+CpuTokens cpuTokens;
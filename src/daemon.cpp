@@ -0,0 +1,515 @@
+/**
+ *  @file    daemon.cpp
+ *  @author  Biniam Abrha Nigusse
+ *  @date    19/10/2026
+ *
+ *  @brief long running converter accepting jobs over a Unix socket, and its client.
+ *  Every job runs in a process of its own forked from the daemon, with its own working
+ *  directory, and takes its encoder threads from the cpu tokens of the daemon.
+ *
+ */
+
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <poll.h>
+#include <csignal>
+#include <map>
+
+int converterMain(int argc, char *argv[]);
+
+#define DAEMON_FINISHED_JOBS    100     // finished jobs kept for STATUS and WAIT
+#define DAEMON_RETENTION_S      86400   // and for no longer than this
+
+// options whose value is a path, relative to the directory of the client
+const stringVec JOB_PATH_OPTIONS = {"--audio", "--cache_dir", "--profile", "--placement_report", "--tmp_dir", "--output_dir"};
+
+
+/**
+ *  @name splitFields
+ *  @brief split a line of the protocol into its tab separated fields
+ *  @return stringVec of fields
+ *
+ */
+stringVec splitFields(const string &line) {
+    stringVec fields;
+    std::istringstream in(line);
+    string field;
+    while(getline(in, field, '\t'))
+        fields.push_back(field);
+    return fields;
+}
+
+/**
+ *  @name sendLine
+ *  @brief write a whole line to a socket
+ *  @return boolean value
+ *
+ */
+bool sendLine(int fd, const string &line) {
+    string data = line + "\n";
+    size_t sent = 0;
+    while(sent < data.size()) {
+        ssize_t n = send(fd, data.data() + sent, data.size() - sent, MSG_NOSIGNAL);
+        if(n < 0 && errno == EINTR)
+            continue;
+        if(n <= 0)
+            return false;
+        sent += n;
+    }
+    return true;
+}
+
+/**
+ *  @name readLine
+ *  @brief blocking read of the next line from a socket, buffer keeps what follows it
+ *  @return boolean value, false once the peer closed the connection
+ *
+ */
+bool readLine(int fd, string &buffer, string &line) {
+    string::size_type eol;
+    while((eol = buffer.find('\n')) == string::npos) {
+        char data[4096];
+        ssize_t n = recv(fd, data, sizeof(data), 0);
+        if(n < 0 && errno == EINTR)
+            continue;
+        if(n <= 0)
+            return false;
+        buffer.append(data, n);
+    }
+    line = buffer.substr(0, eol);
+    buffer.erase(0, eol + 1);
+    return true;
+}
+
+/**
+ *  @name socketAddress
+ *  @brief address of a Unix socket path
+ *  @return boolean value, false if the path is too long
+ *
+ */
+bool socketAddress(const string &path, struct sockaddr_un &addr) {
+    memset(&addr, 0, sizeof(addr));
+    addr.sun_family = AF_UNIX;
+    if(path.size() >= sizeof(addr.sun_path))
+        return false;
+    strcpy(addr.sun_path, path.c_str());
+    return true;
+}
+
+/**
+ *  @name Job
+ *  @brief a job submitted to the daemon
+ *
+ */
+struct Job {
+    int id;
+    int priority;
+    string cwd;
+    stringVec args;
+    string dir;
+    string state = "queued";
+    pid_t pid = -1;
+    int status = -1;
+    std::chrono::steady_clock::time_point submitted, started, finished;
+    vector<int> waiters;
+
+    string output() const {
+        if(args.size() < 3)
+            return "";
+        auto it = find(args.begin(), args.end(), "--output_dir");
+        return (it != args.end() && it + 1 != args.end() ? *(it + 1) : dir + "/output") + "/" + args[2];
+    }
+};
+
+/**
+ *  @name ConverterDaemon
+ *  @brief queue of the submitted jobs, started by priority then submission order while
+ *  fewer than maxJobs run. The running jobs share the cpu tokens of the daemon, a pipe
+ *  inherited by the job processes, and compete for them as the workers of a job do.
+ *
+*/
+class ConverterDaemon {
+private:
+    string socketPath;
+    string stateDir;
+    int maxJobs;
+    int tokens;
+    int listenFd = -1;
+    int tokenPipe[2] = {-1, -1};
+    int nextId = 1;
+    map<int, Job> jobs;
+    map<int, string> clients;   // connection -> unread input
+
+public:
+    ConverterDaemon(const string &socketPath, const string &stateDir, int maxJobs, int tokens) :
+            socketPath(socketPath), stateDir(stateDir), maxJobs(max(1, maxJobs)), tokens(max(1, tokens)) {}
+
+    /**
+     *  @name run
+     *  @brief serve the socket until the daemon is killed
+     *  @return integer, non zero if the socket cannot be opened
+     *
+     */
+    int run() {
+        struct sockaddr_un addr;
+        if(!socketAddress(socketPath, addr)) {
+            cerr << "Socket path too long: " << socketPath << endl;
+            return -1;
+        }
+        unlink(socketPath.c_str());
+        listenFd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+        if(listenFd < 0 || ::bind(listenFd, (struct sockaddr *) &addr, sizeof(addr)) < 0 || listen(listenFd, 16) < 0) {
+            perror("daemon socket");
+            return -1;
+        }
+        if(pipe2(tokenPipe, O_CLOEXEC) < 0) {
+            perror("pipe2");
+            return -1;
+        }
+        refillTokens();
+        fs::create_directories(stateDir);
+        signal(SIGPIPE, SIG_IGN);
+        setvbuf(stdout, nullptr, _IOLBF, 0);
+
+        printf(" --- Daemon listening on %s, %d jobs at a time, %d cpu tokens\n", socketPath.c_str(), maxJobs, tokens);
+
+        while(true) {
+            vector<struct pollfd> fds = {{listenFd, POLLIN, 0}};
+            for(auto &c : clients)
+                fds.push_back({c.first, POLLIN, 0});
+            poll(fds.data(), fds.size(), 200);
+
+            if(fds[0].revents & POLLIN) {
+                int fd = accept4(listenFd, nullptr, nullptr, SOCK_CLOEXEC);
+                if(fd >= 0)
+                    clients[fd] = "";
+            }
+            for(size_t i = 1; i < fds.size(); i++)
+                if(fds[i].revents & (POLLIN | POLLHUP | POLLERR))
+                    serve(fds[i].fd);
+
+            reap();
+            prune();
+            schedule();
+        }
+    }
+
+private:
+    // tokens held by a crashed job are lost, the pool is reset whenever no job runs
+    void refillTokens() {
+        char bytes[256];
+        int flags = fcntl(tokenPipe[0], F_GETFL);
+        fcntl(tokenPipe[0], F_SETFL, flags | O_NONBLOCK);
+        while(read(tokenPipe[0], bytes, sizeof(bytes)) > 0);
+        fcntl(tokenPipe[0], F_SETFL, flags);
+
+        memset(bytes, 0, sizeof(bytes));
+        for(int left = tokens; left > 0; left -= sizeof(bytes))
+            if(write(tokenPipe[1], bytes, min(left, int(sizeof(bytes)))) < 0)
+                break;
+    }
+
+    void serve(int fd) {
+        char data[4096];
+        ssize_t n = recv(fd, data, sizeof(data), 0);
+        if(n <= 0) {
+            drop(fd);
+            return;
+        }
+        clients[fd].append(data, n);
+
+        string::size_type eol;
+        while(clients.count(fd) && (eol = clients[fd].find('\n')) != string::npos) {
+            string line = clients[fd].substr(0, eol);
+            clients[fd].erase(0, eol + 1);
+            command(fd, splitFields(line));
+        }
+    }
+
+    void drop(int fd) {
+        close(fd);
+        clients.erase(fd);
+        for(auto &j : jobs)
+            j.second.waiters.erase(std::remove(j.second.waiters.begin(), j.second.waiters.end(), fd), j.second.waiters.end());
+    }
+
+    void command(int fd, const stringVec &fields) {
+        if(fields.empty())
+            return;
+
+        // SUBMIT priority cwd args...
+        if(fields[0] == "SUBMIT" && fields.size() >= 6) {
+            Job job;
+            job.id = nextId++;
+            job.priority = atoi(fields[1].c_str());
+            job.cwd = fields[2];
+            job.args.assign(fields.begin() + 3, fields.end());
+            job.dir = stateDir + "/job-" + to_string(job.id);
+            job.submitted = std::chrono::steady_clock::now();
+            absolutePaths(job);
+            jobs[job.id] = job;
+            printf(" --- Job %d queued with priority %d\n", job.id, job.priority);
+            sendLine(fd, "JOB\t" + to_string(job.id));
+        }
+        // STATUS [id]
+        else if(fields[0] == "STATUS") {
+            int only = fields.size() > 1 ? atoi(fields[1].c_str()) : 0;
+            for(auto &j : jobs)
+                if(only == 0 || j.first == only)
+                    sendLine(fd, statusLine(j.second));
+            sendLine(fd, "END");
+        }
+        // WAIT id
+        else if(fields[0] == "WAIT" && fields.size() > 1) {
+            auto it = jobs.find(atoi(fields[1].c_str()));
+            if(it == jobs.end())
+                sendLine(fd, "ERROR\tunknown job");
+            else if(it->second.state == "done" || it->second.state == "failed")
+                sendLine(fd, doneLine(it->second));
+            else
+                it->second.waiters.push_back(fd);
+        }
+        else
+            sendLine(fd, "ERROR\tunknown command");
+    }
+
+    void absolutePaths(Job &job) {
+        auto absolute = [&](string &path) {
+            if(!path.empty() && path[0] != '/')
+                path = job.cwd + "/" + path;
+        };
+        absolute(job.args[0]);
+        for(size_t i = 3; i + 1 < job.args.size(); i++)
+            if(find(JOB_PATH_OPTIONS.begin(), JOB_PATH_OPTIONS.end(), job.args[i]) != JOB_PATH_OPTIONS.end())
+                absolute(job.args[i + 1]);
+    }
+
+    string statusLine(const Job &job) const {
+        auto now = std::chrono::steady_clock::now();
+        auto since = job.state == "queued" ? job.submitted : job.started;
+        auto until = job.state == "done" || job.state == "failed" ? job.finished : now;
+        long seconds = std::chrono::duration_cast<std::chrono::seconds>(until - since).count();
+        return to_string(job.id) + "\t" + job.state + "\t" + to_string(job.priority) + "\t" + to_string(seconds) + "s\t" +
+               job.output() + "\t" + job.dir + "/job.log";
+    }
+
+    string doneLine(const Job &job) const {
+        return "DONE\t" + to_string(job.id) + "\t" + to_string(job.status) + "\t" + job.output();
+    }
+
+    // the finished jobs past the retention are forgotten, the oldest first
+    void prune() {
+        auto now = std::chrono::steady_clock::now();
+        int finished = 0;
+        for(auto &j : jobs)
+            finished += j.second.state == "done" || j.second.state == "failed";
+        for(auto it = jobs.begin(); it != jobs.end();) {
+            const Job &job = it->second;
+            bool over = job.state == "done" || job.state == "failed";
+            if(over && (finished > DAEMON_FINISHED_JOBS ||
+                        std::chrono::duration_cast<std::chrono::seconds>(now - job.finished).count() > DAEMON_RETENTION_S)) {
+                finished--;
+                it = jobs.erase(it);
+            }
+            else
+                ++it;
+        }
+    }
+
+    void reap() {
+        int status;
+        pid_t pid;
+        while((pid = waitpid(-1, &status, WNOHANG)) > 0) {
+            for(auto &j : jobs) {
+                Job &job = j.second;
+                if(job.pid != pid)
+                    continue;
+                job.status = WIFEXITED(status) ? WEXITSTATUS(status) : -1;
+                job.state = job.status == 0 ? "done" : "failed";
+                job.finished = std::chrono::steady_clock::now();
+                printf(" --- Job %d %s\n", job.id, job.state.c_str());
+                for(int fd : job.waiters)
+                    sendLine(fd, doneLine(job));
+                job.waiters.clear();
+            }
+        }
+
+        bool running = false;
+        for(auto &j : jobs)
+            running = running || j.second.state == "running";
+        static bool wasRunning = false;
+        if(wasRunning && !running)
+            refillTokens();
+        wasRunning = running;
+    }
+
+    void schedule() {
+        int running = 0;
+        for(auto &j : jobs)
+            running += j.second.state == "running";
+
+        while(running < maxJobs) {
+            Job *next = nullptr;
+            for(auto &j : jobs)
+                if(j.second.state == "queued" && (next == nullptr || j.second.priority > next->priority))
+                    next = &j.second;
+            if(next == nullptr)
+                return;
+            start(*next);
+            running++;
+        }
+    }
+
+    void start(Job &job) {
+        fs::create_directories(job.dir);
+        job.state = "running";
+        job.started = std::chrono::steady_clock::now();
+
+        job.pid = fork();
+        if(job.pid == 0) {
+            // the job runs in its own directory, its ./tmp/ and ./output/ are private
+            close(listenFd);
+            for(auto &c : clients)
+                close(c.first);
+            if(chdir(job.dir.c_str()) != 0)
+                _exit(1);
+            int log = open("job.log", O_WRONLY | O_CREAT | O_TRUNC, 0644);
+            if(log >= 0) {
+                dup2(log, STDOUT_FILENO);
+                dup2(log, STDERR_FILENO);
+                close(log);
+            }
+            signal(SIGPIPE, SIG_DFL);
+            cpuTokens.attachShared(tokenPipe[0], tokenPipe[1]);
+
+            vector<char *> argv = {(char *) "converter"};
+            for(auto &arg : job.args)
+                argv.push_back(const_cast<char *>(arg.c_str()));
+            argv.push_back(nullptr);
+            int ret = converterMain(argv.size() - 1, argv.data());
+            fflush(stdout);
+            cout.flush();
+            _exit(ret);
+        }
+        if(job.pid < 0) {
+            job.state = "failed";
+            job.finished = job.started;
+        }
+        else
+            printf(" --- Job %d started, pid %d\n", job.id, job.pid);
+    }
+};
+
+/**
+ *  @name runDaemon
+ *  @brief --daemon socket [--jobs n] [--cpu_budget n] [--state_dir dir]
+ *  @return integer exit code
+ *
+ */
+int runDaemon(int argc, char *argv[]) {
+    string socketPath = getCmdOption(argv, argv + argc, "--daemon") ? getCmdOption(argv, argv + argc, "--daemon") : "";
+    if(socketPath.empty()) {
+        input_helper(argv[0]);
+        return -1;
+    }
+    int maxJobs = 2;
+    int tokens = thread::hardware_concurrency();
+    string stateDir = socketPath + ".jobs";
+    if(cmdOptionExists(argv, argv + argc, "--jobs"))
+        maxJobs = atoi(getCmdOption(argv, argv + argc, "--jobs"));
+    if(cmdOptionExists(argv, argv + argc, "--cpu_budget") && atoi(getCmdOption(argv, argv + argc, "--cpu_budget")) > 0)
+        tokens = atoi(getCmdOption(argv, argv + argc, "--cpu_budget"));
+    if(cmdOptionExists(argv, argv + argc, "--state_dir"))
+        stateDir = getCmdOption(argv, argv + argc, "--state_dir");
+
+    ConverterDaemon daemon(socketPath, fs::absolute(stateDir).string(), maxJobs, tokens);
+    return daemon.run();
+}
+
+/**
+ *  @name runClient
+ *  @brief --submit socket input_path pattern output [options] [--priority n] [--wait],
+ *  or --status socket [id]
+ *  @return integer exit code, the exit status of the job with --wait
+ *
+ */
+int runClient(int argc, char *argv[]) {
+    bool submit = cmdOptionExists(argv, argv + argc, "--submit");
+    char *socketOption = getCmdOption(argv, argv + argc, submit ? "--submit" : "--status");
+    struct sockaddr_un addr;
+    if(socketOption == nullptr || !socketAddress(socketOption, addr)) {
+        input_helper(argv[0]);
+        return -1;
+    }
+
+    int fd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    if(fd < 0 || connect(fd, (struct sockaddr *) &addr, sizeof(addr)) < 0) {
+        perror("connect");
+        return -1;
+    }
+    string buffer, line;
+
+    if(!submit) {
+        char *id = getCmdOption(argv, argv + argc, socketOption);
+        sendLine(fd, string("STATUS") + (id && id[0] != '-' ? string("\t") + id : ""));
+        while(readLine(fd, buffer, line) && line != "END")
+            printf("%s\n", line.c_str());
+        close(fd);
+        return 0;
+    }
+
+    // the converter arguments, without the options of the client
+    int priority = 0;
+    bool wait = false;
+    char cwd[PATH_MAX];
+    string request = "SUBMIT\t";
+    stringVec args;
+    for(int i = 1; i < argc; i++) {
+        string arg = argv[i];
+        if(arg == "--submit" || arg == "--priority") {
+            if(arg == "--priority" && i + 1 < argc)
+                priority = atoi(argv[i + 1]);
+            i++;
+        }
+        else if(arg == "--wait")
+            wait = true;
+        else if(arg.find_first_of("\t\n") != string::npos) {
+            cerr << "Arguments cannot contain tabs or new lines: " << arg << endl;
+            return -1;
+        }
+        else
+            args.push_back(arg);
+    }
+    if(args.size() < 3 || getcwd(cwd, sizeof(cwd)) == nullptr) {
+        input_helper(argv[0]);
+        return -1;
+    }
+
+    request += to_string(priority) + "\t" + cwd;
+    for(auto &arg : args)
+        request += "\t" + arg;
+    if(!sendLine(fd, request) || !readLine(fd, buffer, line)) {
+        cerr << "No answer from the daemon" << endl;
+        return -1;
+    }
+    stringVec reply = splitFields(line);
+    if(reply.size() < 2 || reply[0] != "JOB") {
+        cerr << line << endl;
+        return -1;
+    }
+    printf(" --- Submitted job %s\n", reply[1].c_str());
+
+    int ret = 0;
+    if(wait) {
+        sendLine(fd, "WAIT\t" + reply[1]);
+        if(readLine(fd, buffer, line)) {
+            stringVec done = splitFields(line);
+            ret = done.size() > 2 ? atoi(done[2].c_str()) : -1;
+            printf(" --- Job %s finished with status %d: %s\n", reply[1].c_str(), ret, done.size() > 3 ? done[3].c_str() : "");
+        }
+        else
+            ret = -1;
+    }
+    close(fd);
+    return ret;
+}
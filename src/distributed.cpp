@@ -0,0 +1,263 @@
+/**
+ *  @file    distributed.cpp
+ *  @author  Biniam Abrha Nigusse
+ *  @date    19/10/2026
+ *
+ *  @brief encoding of the windows on other nodes. The coordinator runs the emitter and the
+ *  farm as usual, the encoder of every window is replaced by a request to the encoder node of
+ *  its worker, which returns the encoded segment. Endpoints are tcp://host:port or
+ *  ipc:///path/to/socket.
+ *
+ */
+
+#include <netdb.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <sys/sendfile.h>
+
+#define REMOTE_CHUNK (1 << 20)
+
+
+/**
+ *  @name openEndpoint
+ *  @brief connect to an endpoint, or listen on it
+ *  @return socket descriptor, -1 on error
+ *
+ */
+int openEndpoint(const string &endpoint, bool listening) {
+    int fd = -1;
+    if(endpoint.compare(0, 6, "ipc://") == 0) {
+        struct sockaddr_un addr;
+        if(!socketAddress(endpoint.substr(6), addr))
+            return -1;
+        fd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+        if(listening)
+            unlink(addr.sun_path);
+        if(fd >= 0 && (listening ? ::bind(fd, (struct sockaddr *) &addr, sizeof(addr)) :
+                                   connect(fd, (struct sockaddr *) &addr, sizeof(addr))) < 0) {
+            close(fd);
+            return -1;
+        }
+    }
+    else if(endpoint.compare(0, 6, "tcp://") == 0) {
+        string hostPort = endpoint.substr(6);
+        string::size_type colon = hostPort.rfind(':');
+        if(colon == string::npos)
+            return -1;
+        string host = hostPort.substr(0, colon);
+        string port = hostPort.substr(colon + 1);
+
+        struct addrinfo hints = {}, *res;
+        hints.ai_family = AF_UNSPEC;
+        hints.ai_socktype = SOCK_STREAM;
+        hints.ai_flags = listening ? AI_PASSIVE : 0;
+        if(getaddrinfo(host == "*" ? nullptr : host.c_str(), port.c_str(), &hints, &res) != 0)
+            return -1;
+        for(struct addrinfo *ai = res; ai != nullptr && fd < 0; ai = ai->ai_next) {
+            fd = socket(ai->ai_family, ai->ai_socktype | SOCK_CLOEXEC, ai->ai_protocol);
+            if(fd < 0)
+                continue;
+            int one = 1;
+            setsockopt(fd, listening ? SOL_SOCKET : IPPROTO_TCP, listening ? SO_REUSEADDR : TCP_NODELAY, &one, sizeof(one));
+            if((listening ? ::bind(fd, ai->ai_addr, ai->ai_addrlen) : connect(fd, ai->ai_addr, ai->ai_addrlen)) < 0) {
+                close(fd);
+                fd = -1;
+            }
+        }
+        freeaddrinfo(res);
+    }
+
+    if(fd >= 0 && listening && listen(fd, 64) < 0) {
+        close(fd);
+        return -1;
+    }
+    return fd;
+}
+
+/**
+ *  @name sendFile
+ *  @brief send a header line followed by the content of a file
+ *  @return boolean value
+ *
+ */
+bool sendFile(int fd, const string &header, const string &path) {
+    int in = open(path.c_str(), O_RDONLY | O_CLOEXEC);
+    struct stat st;
+    if(in < 0 || fstat(in, &st) != 0) {
+        if(in >= 0)
+            close(in);
+        return sendLine(fd, header + "\t-1");
+    }
+    bool sent = sendLine(fd, header + "\t" + to_string(st.st_size));
+    off_t offset = 0;
+    while(sent && offset < st.st_size) {
+        ssize_t n = sendfile(fd, in, &offset, st.st_size - offset);
+        if(n < 0 && errno == EINTR)
+            continue;
+        sent = n > 0;
+    }
+    close(in);
+    return sent;
+}
+
+/**
+ *  @name receiveFile
+ *  @brief write size bytes of a socket to a file, buffer holds what was already read
+ *  @return boolean value
+ *
+ */
+bool receiveFile(int fd, string &buffer, long size, const string &path) {
+    int out = open(path.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+    bool received = out >= 0;
+    vector<char> data(REMOTE_CHUNK);
+    while(size > 0) {
+        ssize_t n;
+        if(!buffer.empty()) {
+            n = min<long>(size, buffer.size());
+            memcpy(data.data(), buffer.data(), n);
+            buffer.erase(0, n);
+        }
+        else if((n = recv(fd, data.data(), min<long>(size, data.size()), 0)) < 0 && errno == EINTR)
+            continue;
+        if(n <= 0) {
+            received = false;
+            break;
+        }
+        if(received && write(out, data.data(), n) != n)
+            received = false;
+        size -= n;
+    }
+    if(out >= 0)
+        close(out);
+    return received;
+}
+
+/**
+ *  @name runRemoteEncode
+ *  @brief --remote_encode endpoint pattern output first frames framerate threads preset mode,
+ *  spawned by remoteConverter for every window
+ *  @return integer exit status of the remote encoder
+ *
+ */
+int runRemoteEncode(int argc, char *argv[]) {
+    if(argc < 11)
+        return 2;
+    string endpoint = argv[2], pattern = argv[3], output = argv[4], mode = argv[10];
+    int first = atoi(argv[5]), frames = atoi(argv[7]);
+
+    int fd = openEndpoint(endpoint, false);
+    if(fd < 0) {
+        cerr << "Encoder node " << endpoint << " not reachable" << endl;
+        return 2;
+    }
+    string request = "ENCODE\t" + mode + "\t" + pattern + "\t" + argv[5] + "\t" + argv[7] + "\t" + argv[6] + "\t" +
+                     argv[8] + "\t" + argv[9] + "\t" + fs::path(output).extension().string();
+    bool sent = sendLine(fd, request);
+    for(int fno = first; sent && mode == "ship" && fno < first + frames; fno++)
+        sent = sendFile(fd, "FRAME\t" + to_string(fno), frameFilename(pattern, fno));
+
+    // SEGMENT status size, then the segment
+    string buffer, line;
+    stringVec reply;
+    if(!sent || !readLine(fd, buffer, line) || (reply = splitFields(line)).size() < 3 || reply[0] != "SEGMENT") {
+        cerr << "Encoder node " << endpoint << " closed the connection" << endl;
+        return 2;
+    }
+    int status = atoi(reply[1].c_str());
+    long size = atol(reply[2].c_str());
+    if(size >= 0 && !receiveFile(fd, buffer, size, output))
+        status = status == 0 ? 2 : status;
+    close(fd);
+    return status;
+}
+
+/**
+ *  @name encodeRequest
+ *  @brief serve one request of a coordinator in the process of its connection
+ *  @return integer exit status of the encoder
+ *
+ */
+int encodeRequest(int fd, const string &workDir) {
+    string buffer, line;
+    stringVec request;
+    if(!readLine(fd, buffer, line) || (request = splitFields(line)).size() < 9 || request[0] != "ENCODE")
+        return 2;
+    string mode = request[1], pattern = request[2], framerate = request[5], threads = request[6], preset = request[7];
+    int first = atoi(request[3].c_str()), frames = atoi(request[4].c_str());
+    string dir = workDir + "/" + to_string(getpid());
+    fs::create_directories(dir);
+
+    // shipped frames keep their names, the pattern points to the local copies
+    bool received = true;
+    if(mode == "ship") {
+        string localPattern = dir + "/" + fs::path(pattern).filename().string();
+        for(int n = 0; n < frames && received; n++) {
+            stringVec frame;
+            received = readLine(fd, buffer, line) && (frame = splitFields(line)).size() >= 3 && frame[0] == "FRAME";
+            long size = received ? atol(frame[2].c_str()) : -1;
+            if(size >= 0)
+                received = receiveFile(fd, buffer, size, frameFilename(localPattern, atoi(frame[1].c_str())));
+        }
+        pattern = localPattern;
+    }
+
+    int status = 2;
+    if(received) {
+        printf(" --- Encoding frames [%d-%d] with %s threads, preset %s\n", first, first + frames - 1, threads.c_str(), preset.c_str());
+        string output = dir + "/segment" + request[8];
+        pid_t pid = imageConverter(pattern, output, "mp4", 1, frames, false, to_string(first), framerate, frames, threads, -1, preset);
+        status = pid > 0 ? waitChildProc(pid) : -1;
+        sendFile(fd, "SEGMENT\t" + to_string(status < 0 ? 255 : status), output);
+    }
+
+    std::error_code ec;
+    fs::remove_all(dir, ec);
+    return status;
+}
+
+/**
+ *  @name runEncoderNode
+ *  @brief --encoder_node endpoint [--slots n] [--ffmpeg_thds n]: encode the windows of the
+ *  coordinators connecting to the endpoint, at most n at a time
+ *  @return integer exit code
+ *
+ */
+int runEncoderNode(int argc, char *argv[]) {
+    string endpoint = getCmdOption(argv, argv + argc, "--encoder_node") ? getCmdOption(argv, argv + argc, "--encoder_node") : "";
+    int slots = thread::hardware_concurrency();
+    if(cmdOptionExists(argv, argv + argc, "--slots"))
+        slots = max(1, atoi(getCmdOption(argv, argv + argc, "--slots")));
+    string workDir = fs::absolute("./node_tmp").string();
+
+    int listenFd = openEndpoint(endpoint, true);
+    if(listenFd < 0) {
+        cerr << "Cannot listen on " << endpoint << endl;
+        input_helper(argv[0]);
+        return -1;
+    }
+    fs::create_directories(workDir);
+    setvbuf(stdout, nullptr, _IOLBF, 0);
+    printf(" --- Encoder node listening on %s, %d encodes at a time\n", endpoint.c_str(), slots);
+
+    // a process per connection, the requests beyond the slots wait in the backlog
+    int running = 0;
+    while(true) {
+        while(running > 0 && waitpid(-1, nullptr, running >= slots ? 0 : WNOHANG) > 0)
+            running--;
+        int fd = accept4(listenFd, nullptr, nullptr, SOCK_CLOEXEC);
+        if(fd < 0)
+            continue;
+        pid_t pid = fork();
+        if(pid == 0) {
+            close(listenFd);
+            signal(SIGPIPE, SIG_IGN);
+            int status = encodeRequest(fd, workDir);
+            close(fd);
+            fflush(stdout);
+            _exit(status < 0 ? 255 : status);
+        }
+        close(fd);
+        if(pid > 0)
+            running++;
+    }
+}
@@ -0,0 +1,154 @@
+/**
+ *  @file    encodeFailures.cpp
+ *  @author  Biniam Abrha Nigusse
+ *  @date    19/10/2026
+ *
+ *  @brief validation of the segments produced by the ffmpeg processes, bounded retries of
+ *  the failed ones and the failure of the job once they run out
+ *
+ */
+
+#include <atomic>
+#include <mutex>
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <endian.h>
+
+#define TS_PACKET_SIZE 188
+
+
+/**
+ *  @name mp4Sanity
+ *  @brief the top level boxes of an MP4/MOV file must cover it exactly, with a moov box
+ *  @return string reason, empty if sane
+ *
+ */
+string mp4Sanity(int fd, uint64_t fileSize) {
+    uint64_t offset = 0;
+    bool moov = false;
+    while(offset < fileSize) {
+        unsigned char header[16];
+        if(pread(fd, header, 8, offset) != 8)
+            return "truncated box header at " + to_string(offset);
+        uint64_t size = be32toh(*(uint32_t *) header);
+        string type((char *) header + 4, 4);
+        if(size == 1) {
+            if(pread(fd, header + 8, 8, offset + 8) != 8)
+                return "truncated box header at " + to_string(offset);
+            size = be64toh(*(uint64_t *) (header + 8));
+        }
+        else if(size == 0)
+            size = fileSize - offset;   // last box, up to the end of the file
+        if(size < 8 || offset + size > fileSize)
+            return "box " + type + " at " + to_string(offset) + " past the end of the file";
+        moov = moov || type == "moov";
+        offset += size;
+    }
+    return moov ? "" : "no moov box";
+}
+
+/**
+ *  @name tsSanity
+ *  @brief an MPEG-TS file is made of whole packets, the first and the last one starting
+ *  with the sync byte
+ *  @return string reason, empty if sane
+ *
+ */
+string tsSanity(int fd, uint64_t fileSize) {
+    unsigned char first = 0, last = 0;
+    if(fileSize % TS_PACKET_SIZE != 0)
+        return "partial transport stream packet";
+    if(pread(fd, &first, 1, 0) != 1 || pread(fd, &last, 1, fileSize - TS_PACKET_SIZE) != 1 || first != 0x47 || last != 0x47)
+        return "transport stream out of sync";
+    return "";
+}
+
+/**
+ *  @name segmentSanity
+ *  @brief quick check of the container of an encoded segment, without decoding it
+ *  @return string reason, empty if the segment looks sane
+ *
+ */
+string segmentSanity(const string &path) {
+    int fd = open(path.c_str(), O_RDONLY | O_CLOEXEC);
+    if(fd < 0)
+        return "missing segment " + path;
+    struct stat st;
+    string reason;
+    string ext = fs::path(path).extension().string();
+    if(fstat(fd, &st) != 0 || st.st_size == 0)
+        reason = "empty segment";
+    else if(ext == ".mp4" || ext == ".mov" || ext == ".m4v" || ext == ".m4a")
+        reason = mp4Sanity(fd, st.st_size);
+    else if(ext == ".ts")
+        reason = tsSanity(fd, st.st_size);
+    close(fd);
+    return reason.empty() ? reason : reason + " in " + path;
+}
+
+/**
+ *  @name encodeFailure
+ *  @brief result of an ffmpeg process: its exit status, then the containers of its outputs
+ *  @return string reason, empty on success
+ *
+ */
+string encodeFailure(int status, const stringVec &outputs) {
+    if(status != 0)
+        return status < 0 ? "ffmpeg killed" : "ffmpeg exited with status " + to_string(status);
+    for(auto &output : outputs) {
+        string reason = segmentSanity(output);
+        if(!reason.empty())
+            return reason;
+    }
+    return "";
+}
+
+/**
+ *  @name EncodeFailures
+ *  @brief a failed window is encoded again up to retries times; the first window that still
+ *  fails aborts the job, the windows not started yet are skipped and the emitter stops
+ *
+*/
+class EncodeFailures {
+private:
+    std::mutex mtx;
+    int retries = 2;
+    std::atomic<bool> failed{false};
+    std::atomic<int> retried{0};
+    string failure;
+
+public:
+
+    void start(int maxRetries) { retries = max(0, maxRetries); }
+
+    int maxRetries() const { return retries; }
+
+    bool aborted() const { return failed; }
+
+    void retry() { retried++; }
+
+    /**
+     *  @name fail
+     *  @brief abort the job, the first failure is the one reported
+     *
+     */
+    void fail(const string &what) {
+        std::lock_guard<std::mutex> lock(mtx);
+        if(!failed)
+            failure = what;
+        failed = true;
+    }
+
+    string reason() {
+        std::lock_guard<std::mutex> lock(mtx);
+        return failure;
+    }
+
+    void print() const {
+        if(retried == 0) return;
+        cout << " ****** Failed encodes retried: " << retried << "\n";
+    }
+};
+
+EncodeFailures encodeFailures;
@@ -0,0 +1,184 @@
+/**
+ *  @file    frameHash.cpp
+ *  @author  Biniam Abrha Nigusse
+ *  @date    19/10/2026
+ *
+ *  @brief content hashing of frame files and detection of runs of identical frames
+ *
+ */
+
+#include <atomic>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+
+/**
+ *  @name hashBytes
+ *  @brief 64 bit hash of a buffer, processing four independent 8 byte lanes per step
+ *  so that the compiler can vectorize the main loop
+ *  @return 64 bit hash value
+ *
+ */
+uint64_t hashBytes(const unsigned char *data, size_t size, uint64_t seed = 0) {
+    const uint64_t prime1 = 0x9E3779B185EBCA87ULL;
+    const uint64_t prime2 = 0xC2B2AE3D27D4EB4FULL;
+    uint64_t lanes[4] = {seed + prime1, seed + prime2, seed, seed - prime1};
+
+    size_t i = 0;
+    for(; i + 32 <= size; i += 32) {
+        for(int l = 0; l < 4; l++) {
+            uint64_t word;
+            memcpy(&word, data + i + 8 * l, sizeof(word));
+            lanes[l] += word * prime2;
+            lanes[l] = (lanes[l] << 31) | (lanes[l] >> 33);
+            lanes[l] *= prime1;
+        }
+    }
+
+    uint64_t h = size;
+    for(int l = 0; l < 4; l++) {
+        h ^= lanes[l] * prime1;
+        h = ((h << 27) | (h >> 37)) * prime2;
+    }
+    for(; i < size; i++) {
+        h ^= data[i] * prime1;
+        h = ((h << 11) | (h >> 53)) * prime2;
+    }
+
+    h ^= h >> 33;
+    h *= prime2;
+    h ^= h >> 29;
+    return h;
+}
+
+/**
+ *  @name hashFile
+ *  @brief hash the content of a file through a read-only mapping
+ *  @return 64 bit hash value, 0 if the file cannot be read
+ *
+ */
+uint64_t hashFile(const string &path, uint64_t seed = 0) {
+    int fd = open(path.c_str(), O_RDONLY | O_CLOEXEC);
+    if(fd < 0)
+        return 0;
+
+    struct stat st;
+    uint64_t h = 0;
+    if(fstat(fd, &st) == 0 && st.st_size > 0) {
+        void *data = mmap(nullptr, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+        if(data != MAP_FAILED) {
+            h = hashBytes((const unsigned char *) data, st.st_size, seed);
+            munmap(data, st.st_size);
+        }
+    }
+
+    close(fd);
+    return h;
+}
+
+/**
+ *  @name sameContent
+ *  @brief byte comparison of two files, the equal hashes of two frames are confirmed
+ *  before one of them is dropped
+ *  @return boolean value, false if a file cannot be read
+ *
+ */
+bool sameContent(const string &a, const string &b) {
+    int fa = open(a.c_str(), O_RDONLY | O_CLOEXEC);
+    int fb = open(b.c_str(), O_RDONLY | O_CLOEXEC);
+    struct stat sa, sb;
+    bool same = fa >= 0 && fb >= 0 && fstat(fa, &sa) == 0 && fstat(fb, &sb) == 0 && sa.st_size == sb.st_size;
+    if(same && sa.st_size > 0) {
+        void *da = mmap(nullptr, sa.st_size, PROT_READ, MAP_PRIVATE, fa, 0);
+        void *db = mmap(nullptr, sb.st_size, PROT_READ, MAP_PRIVATE, fb, 0);
+        same = da != MAP_FAILED && db != MAP_FAILED && memcmp(da, db, sa.st_size) == 0;
+        if(da != MAP_FAILED)
+            munmap(da, sa.st_size);
+        if(db != MAP_FAILED)
+            munmap(db, sb.st_size);
+    }
+    if(fa >= 0)
+        close(fa);
+    if(fb >= 0)
+        close(fb);
+    return same;
+}
+
+/**
+ *  @name DedupStats
+ *  @brief counters of the duplicate frame detection, reported at the end of the job
+ *
+ */
+struct DedupStats {
+    std::atomic<unsigned long> frames{0};
+    std::atomic<unsigned long> duplicates{0};
+
+    void print() const {
+        if(frames == 0) return;
+        cout << " ****** Duplicate frames skipped: " << duplicates << " of " << frames
+             << " (" << (duplicates * 100 / frames) << "%)\n";
+    }
+};
+
+DedupStats dedupStats;
+
+/**
+ *  @name duplicateRuns
+ *  @brief group consecutive identical frames of a window, equal hashes are confirmed by
+ *  comparing the files
+ *  @return vector of (first frame index, run length)
+ *
+ */
+vector<pair<int, int>> duplicateRuns(const string &pattern, const vector<int> &frames) {
+    vector<pair<int, int>> runs;
+    uint64_t previous = 0;
+    string previousPath;
+
+    for(int fno : frames) {
+        string path = frameFilename(pattern, fno);
+        uint64_t h = hashFile(path);
+        // a hash collision must never drop a frame
+        if(!runs.empty() && h != 0 && h == previous && sameContent(previousPath, path))
+            runs.back().second++;
+        else
+            runs.emplace_back(fno, 1);
+        previous = h;
+        previousPath = path;
+    }
+
+    dedupStats.frames += frames.size();
+    dedupStats.duplicates += frames.size() - runs.size();
+    return runs;
+}
+
+/**
+ *  @name writeConcatList
+ *  @brief write an ffconcat list showing every run once, for as long as the whole run lasts.
+ *  The concat demuxer ignores the duration of the last entry, the last image of a longer run
+ *  is listed again for its last frame.
+ *  @return integer number of frames listed, 0 if the list cannot be written
+ *
+ */
+int writeConcatList(const string &listPath, const string &pattern, const vector<pair<int, int>> &runs, int framerate) {
+    ofstream file(listPath);
+    if(!file.is_open() || runs.empty())
+        return 0;
+
+    file.precision(12);
+    file << "ffconcat version 1.0\n";
+    for(size_t i = 0; i < runs.size(); i++) {
+        bool last = i + 1 == runs.size();
+        int frames = last && runs[i].second > 1 ? runs[i].second - 1 : runs[i].second;
+        file << "file '" << fs::absolute(frameFilename(pattern, runs[i].first)).string() << "'\n";
+        file << "duration " << double(frames) / framerate << "\n";
+    }
+    int listed = runs.size();
+    if(runs.back().second > 1) {
+        file << "file '" << fs::absolute(frameFilename(pattern, runs.back().first)).string() << "'\n";
+        listed++;
+    }
+
+    return file ? listed : 0;
+}
@@ -0,0 +1,118 @@
+/**
+ *  @file    frameLocality.cpp
+ *  @author  Biniam Abrha Nigusse
+ *  @date    19/10/2026
+ *
+ *  @brief scheduling of the windows on the render nodes holding their frames: the frame
+ *  ranges of every node come from the job manifest, a window is encoded by the encoder node
+ *  of its range and only its segment is sent back
+ *
+ */
+
+#include <mutex>
+#include <fstream>
+
+
+/**
+ *  @name FrameRange
+ *  @brief frames rendered by a node, with the pattern of their files on its local disk
+ *
+ */
+struct FrameRange {
+    int first;
+    int last;
+    string endpoint;
+    string pattern;
+};
+
+/**
+ *  @name FrameLocality
+ *  @brief the windows never span two ranges: the emitter cuts them at the boundaries, so
+ *  that every window is encoded by a single node from its local frames. Frames out of the
+ *  manifest are encoded as usual.
+ *
+*/
+class FrameLocality {
+private:
+    std::mutex mtx;
+    vector<FrameRange> ranges;
+    int localWindows = 0;
+    int localFrames = 0;
+    uintmax_t segmentBytes = 0;
+
+public:
+
+    /**
+     *  @name load
+     *  @brief read a manifest, one range per line: first last endpoint pattern, # comments
+     *  @return boolean value, false if no range could be read
+     *
+     */
+    bool load(const string &path) {
+        ifstream manifest(path);
+        string line;
+        while(getline(manifest, line)) {
+            if(line.empty() || line[0] == '#')
+                continue;
+            std::istringstream in(line);
+            FrameRange range;
+            if(in >> range.first >> range.last >> range.endpoint >> range.pattern && range.first <= range.last)
+                ranges.push_back(range);
+            else
+                cerr << "Manifest line ignored: " << line << endl;
+        }
+        sort(ranges.begin(), ranges.end(), [](const FrameRange &a, const FrameRange &b) { return a.first < b.first; });
+        return !ranges.empty();
+    }
+
+    bool isEnabled() const { return !ranges.empty(); }
+
+    /**
+     *  @name owner
+     *  @brief range holding every frame of a window
+     *  @return pointer to the range, nullptr if the window is not on a single node
+     *
+     */
+    const FrameRange *owner(int firstFrame, int lastFrame) const {
+        for(auto &range : ranges)
+            if(range.first <= firstFrame && lastFrame <= range.last)
+                return &range;
+        return nullptr;
+    }
+
+    /**
+     *  @name split
+     *  @brief cut a window at the boundaries of the ranges
+     *  @return vector of the windows to send
+     *
+     */
+    vector<vector<int>> split(const vector<int> &frames) const {
+        vector<vector<int>> windows;
+        const FrameRange *current = nullptr;
+        for(int fno : frames) {
+            const FrameRange *range = owner(fno, fno);
+            if(windows.empty() || range != current)
+                windows.emplace_back();
+            windows.back().push_back(fno);
+            current = range;
+        }
+        return windows;
+    }
+
+    // a window encoded on the node of its frames, with the size of its segments
+    void encoded(int frames, uintmax_t bytes) {
+        std::lock_guard<std::mutex> lock(mtx);
+        localWindows++;
+        localFrames += frames;
+        segmentBytes += bytes;
+    }
+
+    void print() {
+        std::lock_guard<std::mutex> lock(mtx);
+        if(ranges.empty()) return;
+        cout << " ****** Windows encoded on the node of their frames: " << localWindows << " (" << localFrames
+             << " frames), segments received (MB): " << segmentBytes / 1048576.0 << "\n";
+    }
+};
+
+FrameLocality frameLocality;
@@ -0,0 +1,175 @@
+/**
+ *  @file    frameTransport.cpp
+ *  @author  Biniam Abrha Nigusse
+ *  @date    19/10/2026
+ *
+ *  @brief hand-off of frames from a worker to its encoder through a bounded pipe ring,
+ *  moving the file pages with splice() instead of copying them through user space
+ *
+ */
+
+#include <atomic>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/ioctl.h>
+#include <sys/stat.h>
+
+
+/**
+ *  @name TransportStats
+ *  @brief counters of the frame transport, reported at the end of the job
+ *
+ */
+struct TransportStats {
+    std::atomic<unsigned long> frames{0};
+    std::atomic<unsigned long> bytesSpliced{0};
+    std::atomic<unsigned long> bytesCopied{0};
+    std::atomic<unsigned long> occupancySamples{0};
+    std::atomic<unsigned long> occupancyPercentSum{0};
+    std::atomic<unsigned long> occupancyPercentMax{0};
+
+    void sampleOccupancy(size_t used, size_t capacity) {
+        if(capacity == 0) return;
+        unsigned long percent = (used * 100) / capacity;
+        occupancySamples++;
+        occupancyPercentSum += percent;
+        unsigned long prev = occupancyPercentMax;
+        while(percent > prev && !occupancyPercentMax.compare_exchange_weak(prev, percent));
+    }
+
+    void print() const {
+        if(frames == 0) return;
+        cout << " ****** Transport bytes spliced per frame: " << (bytesSpliced / frames) << "\n";
+        cout << " ****** Transport bytes copied per frame: " << (bytesCopied / frames) << "\n";
+        if(occupancySamples > 0)
+            cout << " ****** Transport ring occupancy avg/max (%): " << (occupancyPercentSum / occupancySamples)
+                 << "/" << occupancyPercentMax << "\n";
+    }
+};
+
+TransportStats transportStats;
+
+
+/**
+ *  @name FramePipe
+ *  @brief a pipe used as a bounded ring between a worker and the stdin of its encoder.
+ *  The writer only blocks when the ring is full, which is the backpressure of the encoder.
+ *
+ */
+class FramePipe {
+private:
+    int fds[2] = {-1, -1};
+    size_t capacity = 0;
+
+public:
+    FramePipe() = default;
+    FramePipe(const FramePipe &) = delete;
+    FramePipe &operator=(const FramePipe &) = delete;
+    ~FramePipe() {
+        closeRead();
+        closeWrite();
+    }
+
+    /**
+     *  @name open
+     *  @brief create the pipe and grow it up to sizeBytes, bounded by /proc/sys/fs/pipe-max-size
+     *  @return boolean value
+     *
+     */
+    bool open(size_t sizeBytes) {
+        if(pipe2(fds, O_CLOEXEC) < 0) {
+            perror("pipe2");
+            return false;
+        }
+
+        size_t maxSize = sizeBytes;
+        ifstream limit("/proc/sys/fs/pipe-max-size");
+        if(limit >> maxSize)
+            sizeBytes = min(sizeBytes, maxSize);
+
+        int size = fcntl(fds[1], F_SETPIPE_SZ, int(sizeBytes));
+        if(size < 0)
+            size = fcntl(fds[1], F_GETPIPE_SZ);
+        capacity = size > 0 ? size_t(size) : 0;
+
+        return true;
+    }
+
+    int readEnd() const { return fds[0]; }
+
+    void closeRead() {
+        if(fds[0] >= 0) close(fds[0]);
+        fds[0] = -1;
+    }
+
+    void closeWrite() {
+        if(fds[1] >= 0) close(fds[1]);
+        fds[1] = -1;
+    }
+
+    /**
+     *  @name sendFile
+     *  @brief move the content of a frame file into the ring. Pages are spliced from the page cache;
+     *  a read/write copy is used only if the filesystem does not support splice.
+     *  @return boolean value, false if the encoder closed its end
+     *
+     */
+    bool sendFile(const string &path, TransportStats &stats) {
+        int fd = ::open(path.c_str(), O_RDONLY | O_CLOEXEC);
+        if(fd < 0) {
+            perror(path.c_str());
+            return true;
+        }
+
+        struct stat st;
+        fstat(fd, &st);
+        size_t remaining = st.st_size;
+
+        int used = 0;
+        if(ioctl(fds[1], FIONREAD, &used) == 0)
+            stats.sampleOccupancy(used, capacity);
+
+        bool ok = true;
+        while(remaining > 0) {
+            ssize_t n = splice(fd, nullptr, fds[1], nullptr, remaining, SPLICE_F_MOVE | SPLICE_F_MORE);
+            if(n > 0) {
+                remaining -= n;
+                stats.bytesSpliced += n;
+                continue;
+            }
+            if(n < 0 && errno == EINTR)
+                continue;
+            if(n < 0 && errno == EINVAL) {
+                ok = copyFile(fd, remaining, stats);
+                break;
+            }
+            ok = (n == 0);
+            break;
+        }
+
+        close(fd);
+        stats.frames++;
+        return ok;
+    }
+
+private:
+    bool copyFile(int fd, size_t remaining, TransportStats &stats) {
+        char buffer[1 << 16];
+        while(remaining > 0) {
+            ssize_t n = read(fd, buffer, min(remaining, sizeof(buffer)));
+            if(n <= 0)
+                return n == 0;
+            for(ssize_t off = 0; off < n; ) {
+                ssize_t w = write(fds[1], buffer + off, n - off);
+                if(w < 0) {
+                    if(errno == EINTR) continue;
+                    return false;
+                }
+                off += w;
+            }
+            remaining -= n;
+            stats.bytesCopied += n;
+        }
+        return true;
+    }
+};
@@ -9,8 +9,10 @@
  */
 
 #include <map>
+#include <set>
 #include <sstream>
 #include <cassert>
+#include <functional>
 #define EVENT_SIZE  ( sizeof (struct inotify_event) )
 #define BUF_LEN     ( 1024 * ( EVENT_SIZE + NAME_MAX + 1) )
 
@@ -95,7 +97,6 @@ public:
         return v;
     }
 
-private:
     /**
     *  @name name2no
     *  @brief extract the integer value from frames filename
@@ -103,7 +104,7 @@ private:
     *  @return integer frame index
     *
     */
-    int name2no(const std::string& name) {
+    static int name2no(const std::string& name) {
         std::string::size_type p = name.rfind('.');
         assert(p != std::string::npos);
         p = name.rfind('_', p);
@@ -115,6 +116,194 @@ private:
     }
 };
 
+/**
+ *  @name SceneWindows
+ *  @brief a class to manage windows whose boundaries are snapped to the nearest scene cut
+ *  within a tolerance of the nominal multiples of the window size. Only the frames around
+ *  the nominal boundaries are analysed.
+ *
+ *
+*/
+class SceneWindows {
+private:
+    int winsize;
+    int totFrames;
+    int tolerance;
+    double threshold;
+    int innerBoundaries;
+    std::function<std::vector<float>(int)> histogramOf;
+
+    std::set<int> arrived;
+    std::map<int, std::vector<float>> histograms;
+    std::map<int, int> boundaries;     // boundary number -> first frame of the window it opens
+    std::set<int> emitted;
+    int cuts = 0;
+
+public:
+    SceneWindows(int n, int totFrames, int tolerance, double threshold,
+                 std::function<std::vector<float>(int)> histogramOf) :
+            winsize(n), totFrames(totFrames), tolerance(tolerance), threshold(threshold), histogramOf(histogramOf) {
+        assert(winsize > 0);
+        // zones of two boundaries never overlap
+        this->tolerance = std::max(0, std::min(tolerance, winsize / 2 - 1));
+        // a remainder shorter than half a window is appended to the last window
+        innerBoundaries = 0;
+        while((innerBoundaries + 1) * winsize < totFrames && totFrames - (innerBoundaries + 1) * winsize >= winsize / 2)
+            innerBoundaries++;
+        boundaries[0] = 0;
+        boundaries[innerBoundaries + 1] = totFrames;
+        std::cout << __func__ << " initialized with size " << n << " and tolerance " << this->tolerance << '\n';
+    }
+
+    /**
+     *  @name addframe
+     *  @brief register an arrived frame, analyse it if it lies near a nominal boundary
+     *  @return vector of the windows completed by this frame
+     *
+     */
+    std::vector<std::vector<int>> addframe(const std::string& name) {
+        int fno = FrameWindows::name2no(name);
+        arrived.insert(fno);
+
+        int k = nearestBoundary(fno);
+        if(k > 0 && boundaries.find(k) == boundaries.end()) {
+            histograms[fno] = histogramOf(fno);
+            resolve(k);
+        }
+
+        std::vector<std::vector<int>> ready;
+        for(int w = 0; w <= innerBoundaries; w++) {
+            if(emitted.count(w) || boundaries.find(w) == boundaries.end() || boundaries.find(w + 1) == boundaries.end())
+                continue;
+            int first = boundaries[w], last = boundaries[w + 1];
+            auto it = arrived.lower_bound(first);
+            int present = 0;
+            for(; it != arrived.end() && *it < last; ++it) present++;
+            if(present != last - first)
+                continue;
+
+            std::vector<int> v;
+            for(int j = first; j < last; j++) {
+                v.push_back(j);
+                arrived.erase(j);
+            }
+            emitted.insert(w);
+            ready.push_back(v);
+        }
+        return ready;
+    }
+
+    int sceneCuts() const { return cuts; }
+
+private:
+    // boundary number whose analysis zone contains fno, 0 if none
+    int nearestBoundary(int fno) const {
+        int k = (fno + winsize / 2) / winsize;
+        if(k < 1 || k > innerBoundaries)
+            return 0;
+        int b = k * winsize;
+        return (fno >= b - tolerance - 1 && fno <= b + tolerance) ? k : 0;
+    }
+
+    // pick the strongest cut of the zone once all its frames are analysed
+    void resolve(int k) {
+        int b = k * winsize;
+        for(int f = b - tolerance - 1; f <= b + tolerance; f++)
+            if(histograms.find(f) == histograms.end())
+                return;
+
+        int best = b;
+        double bestScore = threshold;
+        for(int c = b - tolerance; c <= b + tolerance; c++) {
+            double score = sceneScore(histograms[c - 1], histograms[c]);
+            if(score > bestScore) {
+                bestScore = score;
+                best = c;
+            }
+        }
+        if(bestScore > threshold)
+            cuts++;
+
+        boundaries[k] = best;
+        histograms.erase(histograms.lower_bound(b - tolerance - 1), histograms.upper_bound(b + tolerance));
+        std::cout << " --- Boundary " << k << " set at frame " << best << (bestScore > threshold ? " (scene cut)" : "") << '\n';
+    }
+};
+
+/**
+ *  @name CostWindows
+ *  @brief a class to manage windows sized by estimated encode cost instead of frame count.
+ *  Frames are analysed in order as the contiguous prefix of the sequence grows; a window
+ *  is closed when its cost reaches the cost of an average window of nominal size.
+ *
+ *
+*/
+class CostWindows {
+private:
+    int winsize;
+    int totFrames;
+    int sampleEvery;
+    CostModel &model;
+    std::function<std::vector<unsigned char>(int)> thumbnailOf;
+
+    std::set<int> arrived;
+    int next = 0;
+    int windowStart = 0;
+    double windowComplexity = 0.0;
+    double totalComplexity = 0.0;
+    double frameComplexity = 1.0;
+    std::vector<unsigned char> previous;
+
+public:
+    CostWindows(int n, int totFrames, int sampleEvery, CostModel &model,
+                std::function<std::vector<unsigned char>(int)> thumbnailOf) :
+            winsize(n), totFrames(totFrames), sampleEvery(std::max(1, sampleEvery)), model(model), thumbnailOf(thumbnailOf) {
+        assert(winsize > 0);
+        std::cout << __func__ << " initialized with nominal size " << n << '\n';
+    }
+
+    /**
+     *  @name addframe
+     *  @brief register an arrived frame and analyse the prefix it completes
+     *  @return vector of the windows completed by this frame
+     *
+     */
+    std::vector<std::vector<int>> addframe(const std::string& name) {
+        arrived.insert(FrameWindows::name2no(name));
+
+        std::vector<std::vector<int>> ready;
+        while(arrived.count(next)) {
+            // frames between two samples share the complexity of the previous sample
+            if(next % sampleEvery == 0) {
+                std::vector<unsigned char> thumb = thumbnailOf(next);
+                frameComplexity = thumbnailComplexity(thumb, previous);
+                previous = thumb;
+            }
+            windowComplexity += frameComplexity;
+            totalComplexity += frameComplexity;
+            arrived.erase(next);
+            next++;
+
+            int frames = next - windowStart;
+            double average = totalComplexity / next;
+            bool full = frames >= winsize * 4 ||
+                        (frames >= std::max(1, winsize / 4) &&
+                         model.cost(windowComplexity, frames) >= model.cost(average * winsize, winsize));
+
+            if(full || next == totFrames) {
+                std::vector<int> v;
+                for(int j = windowStart; j < next; j++)
+                    v.push_back(j);
+                model.recordWindow(windowStart, windowComplexity);
+                ready.push_back(v);
+                windowStart = next;
+                windowComplexity = 0.0;
+            }
+        }
+        return ready;
+    }
+};
+
 // utility to print window data
 void printwin(int wno, const std::vector<int>& v) {
     //std::cout << "window no " << wno << '\t';
@@ -0,0 +1,217 @@
+/**
+ *  @file    jobJournal.cpp
+ *  @author  Biniam Abrha Nigusse
+ *  @date    19/10/2026
+ *
+ *  @brief append-only journal of the windows of a job, so that a job restarted after a crash
+ *  only encodes again the windows that did not complete
+ *
+ */
+
+#include <mutex>
+#include <map>
+#include <set>
+#include <fcntl.h>
+#include <unistd.h>
+
+
+/**
+ *  @name syncPath
+ *  @brief flush a file, or the entries of a directory, to the disk
+ *  @return boolean value
+ *
+ */
+bool syncPath(const string &path) {
+    int fd = open(path.c_str(), O_RDONLY | O_CLOEXEC);
+    if(fd < 0)
+        return false;
+    bool synced = fsync(fd) == 0;
+    close(fd);
+    return synced;
+}
+
+/**
+ *  @name JobJournal
+ *  @brief one line per event, written at once and synced before the job moves on:
+ *      job        key of the job parameters
+ *      dispatched first frame, frames
+ *      completed  first frame, frames, then path, size and hash of every segment
+ *  A segment is synced before its completion is recorded. On restart a journal of the same
+ *  job gives back its completed windows once their segments are verified, a torn last line
+ *  is ignored.
+ *
+*/
+class JobJournal {
+private:
+    struct Segment {
+        string path;
+        uintmax_t size;
+        uint64_t hash;
+    };
+
+    std::mutex mtx;
+    int fd = -1;
+    string dir;
+    map<int, pair<int, vector<Segment>>> completed;     // first frame -> frames, segments
+    int lost = 0;
+    bool torn = false;
+    int recovered = 0;
+    int recoveredFrames = 0;
+    int rejected = 0;
+
+public:
+
+    /**
+     *  @name open
+     *  @brief continue the journal at path if it belongs to the job identified by key,
+     *  start a new one otherwise
+     *  @return boolean value, false if the journal cannot be written
+     *
+     */
+    bool open(const string &path, const string &key) {
+        std::lock_guard<std::mutex> lock(mtx);
+        dir = fs::path(path).parent_path().string();
+        bool resume = load(path, key);
+        if(!resume)
+            completed.clear();
+
+        fd = ::open(path.c_str(), O_WRONLY | O_CREAT | O_APPEND | O_CLOEXEC | (resume ? 0 : O_TRUNC), 0644);
+        if(fd < 0) {
+            perror("journal");
+            return false;
+        }
+        if(!resume) {
+            append("job\t" + key);
+            syncPath(dir);
+        }
+        else {
+            // the next records start on a line of their own
+            if(torn && write(fd, "\n", 1) != 1)
+                perror("journal");
+            printf(" --- Resuming the job: %zu windows completed, %d interrupted\n", completed.size(), lost);
+        }
+        return true;
+    }
+
+    bool isEnabled() const { return fd >= 0; }
+
+    /**
+     *  @name recover
+     *  @brief give back a window completed by a previous run, if its segments are still the
+     *  ones recorded
+     *  @return boolean value, true if the window does not need to be encoded
+     *
+     */
+    bool recover(int firstFrame, int frames, const stringVec &outputs) {
+        std::unique_lock<std::mutex> lock(mtx);
+        auto it = completed.find(firstFrame);
+        if(it == completed.end() || it->second.first != frames || it->second.second.size() != outputs.size())
+            return false;
+        vector<Segment> segments = it->second.second;
+        completed.erase(it);
+        lock.unlock();
+
+        for(size_t n = 0; n < outputs.size(); n++) {
+            std::error_code ec;
+            const Segment &s = segments[n];
+            if(s.path != outputs[n] || fs::file_size(s.path, ec) != s.size || ec || hashFile(s.path) != s.hash) {
+                lock.lock();
+                rejected++;
+                return false;
+            }
+        }
+
+        lock.lock();
+        recovered++;
+        recoveredFrames += frames;
+        return true;
+    }
+
+    /**
+     *  @name dispatch
+     *  @brief record that a window is about to be encoded, its outputs left by an interrupted
+     *  encoder are removed
+     *
+     */
+    void dispatch(int firstFrame, int frames, const stringVec &outputs) {
+        for(auto &output : outputs) {
+            std::error_code ec;
+            fs::remove(output, ec);
+        }
+        std::lock_guard<std::mutex> lock(mtx);
+        append("dispatched\t" + to_string(firstFrame) + "\t" + to_string(frames));
+    }
+
+    /**
+     *  @name complete
+     *  @brief record a completed window once its segments are on the disk
+     *
+     */
+    void complete(int firstFrame, int frames, const stringVec &outputs) {
+        string line = "completed\t" + to_string(firstFrame) + "\t" + to_string(frames);
+        for(auto &output : outputs) {
+            std::error_code ec;
+            uintmax_t size = fs::file_size(output, ec);
+            if(ec || size == 0 || !syncPath(output))
+                return;
+            line += "\t" + output + "\t" + to_string(size) + "\t" + to_string(hashFile(output));
+        }
+
+        std::lock_guard<std::mutex> lock(mtx);
+        syncPath(dir);
+        append(line);
+    }
+
+    void print() {
+        std::lock_guard<std::mutex> lock(mtx);
+        if(recovered == 0 && rejected == 0) return;
+        cout << " ****** Windows recovered from the journal: " << recovered << " (" << recoveredFrames
+             << " frames), rejected: " << rejected << "\n";
+    }
+
+private:
+
+    // a single write per line, on the disk before returning
+    void append(const string &line) {
+        if(fd < 0)
+            return;
+        string data = line + "\n";
+        if(write(fd, data.data(), data.size()) != ssize_t(data.size()) || fdatasync(fd) != 0)
+            perror("journal");
+    }
+
+    bool load(const string &path, const string &key) {
+        ifstream in(path);
+        string line;
+        if(!getline(in, line) || in.eof() || line != "job\t" + key)
+            return false;
+
+        set<int> dispatched;
+        while(getline(in, line)) {
+            if(in.eof()) {
+                torn = true;  // no new line, cut by the crash
+                break;
+            }
+            stringVec fields;
+            std::istringstream fieldsIn(line);
+            string field;
+            while(getline(fieldsIn, field, '\t'))
+                fields.push_back(field);
+
+            if(fields.size() == 3 && fields[0] == "dispatched")
+                dispatched.insert(atoi(fields[1].c_str()));
+            else if(fields.size() >= 6 && (fields.size() - 3) % 3 == 0 && fields[0] == "completed") {
+                vector<Segment> segments;
+                for(size_t n = 3; n < fields.size(); n += 3)
+                    segments.push_back({fields[n], strtoull(fields[n + 1].c_str(), nullptr, 10), strtoull(fields[n + 2].c_str(), nullptr, 10)});
+                int first = atoi(fields[1].c_str());
+                completed[first] = {atoi(fields[2].c_str()), segments};
+                dispatched.erase(first);
+            }
+        }
+        lost = dispatched.size();
+        return true;
+    }
+};
+
+JobJournal jobJournal;
@@ -0,0 +1,260 @@
+/**
+ *  @file    liveStream.cpp
+ *  @author  Biniam Abrha Nigusse
+ *  @date    19/10/2026
+ *
+ *  @brief live MPEG-TS stream of the job in window order, to stdout, a FIFO or a listening
+ *  socket, while the render is still going
+ *
+ */
+
+#include <map>
+#include <mutex>
+#include <thread>
+#include <condition_variable>
+#include <fstream>
+#include <fcntl.h>
+#include <sys/socket.h>
+#include <sys/sendfile.h>
+#include <sys/stat.h>
+
+// defined with the encoder nodes, tcp://host:port or ipc:///path
+int openEndpoint(const string &endpoint, bool listening);
+
+
+/**
+ *  @name LiveStream
+ *  @brief the windows, remuxed to MPEG-TS with the timestamps of the job, are written in
+ *  frame order by a thread of their own, so that a slow viewer never holds the workers. The
+ *  windows waiting for an earlier one are held in memory up to the buffer, the later ones
+ *  wait on disk. The windows streamed while no viewer is connected are dropped, a viewer
+ *  joining the stream starts at the next window.
+ *
+*/
+class LiveStream {
+private:
+    struct Segment {
+        int frames;
+        string path;            // empty for a window left out of the stream
+        vector<char> data;      // held in memory, the file is removed
+    };
+
+    std::mutex mtx;
+    std::condition_variable ready;
+    std::thread writer;
+    map<int, Segment> pending;
+    int nextIndex = 0;
+    string target;
+    bool fifo = false;
+    int listenFd = -1;
+    int outFd = -1;
+    int stdoutFd = -1;
+    size_t bufferBytes = 0;
+    size_t heldBytes = 0;
+    size_t peakHeldBytes = 0;
+    bool finishing = false;
+    bool enabled = false;
+
+    // written by the writer thread only
+    int streamed = 0;
+    int dropped = 0;
+    int spilled = 0;
+    uintmax_t streamedBytes = 0;
+
+public:
+
+    ~LiveStream() { finish(); }
+
+    /**
+     *  @name takeStdout
+     *  @brief keep stdout for the stream, before anything is printed, the logs of the job and
+     *  of its processes go to stderr
+     *
+     */
+    void takeStdout() {
+        if(stdoutFd >= 0)
+            return;
+        fflush(stdout);
+        stdoutFd = fcntl(STDOUT_FILENO, F_DUPFD_CLOEXEC, 0);
+        dup2(STDERR_FILENO, STDOUT_FILENO);
+    }
+
+    /**
+     *  @name open
+     *  @brief stream to target: - for stdout, the logs of the job move to stderr; a tcp:// or
+     *  ipc:// endpoint to listen on; a FIFO, created if missing, or a file
+     *  @return boolean value, false if the target cannot be opened
+     *
+     */
+    bool open(const string &streamTarget, long bufferMB) {
+        target = streamTarget;
+        bufferBytes = size_t(max(0L, bufferMB)) << 20;
+
+        struct stat st;
+        if(target == "-") {
+            takeStdout();
+            outFd = stdoutFd;
+        }
+        else if(target.compare(0, 6, "tcp://") == 0 || target.compare(0, 6, "ipc://") == 0) {
+            listenFd = openEndpoint(target, true);
+            if(listenFd < 0)
+                return false;
+            fcntl(listenFd, F_SETFL, O_NONBLOCK);
+        }
+        else if(stat(target.c_str(), &st) == 0 ? S_ISFIFO(st.st_mode) : mkfifo(target.c_str(), 0644) == 0)
+            fifo = true;
+        else
+            outFd = ::open(target.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+        if(outFd < 0 && listenFd < 0 && !fifo)
+            return false;
+
+        // a viewer leaving must not kill the job
+        signal(SIGPIPE, SIG_IGN);
+        enabled = true;
+        writer = std::thread([this] { run(); });
+        return true;
+    }
+
+    bool isOpen() const { return enabled; }
+
+    /**
+     *  @name add
+     *  @brief add the stream of a completed window, an empty path leaves the window out
+     *
+     */
+    void add(int firstIndex, int frames, const string &segmentPath) {
+        Segment segment{frames, segmentPath, {}};
+        std::error_code ec;
+        uintmax_t size = segmentPath.empty() ? 0 : fs::file_size(segmentPath, ec);
+
+        std::unique_lock<std::mutex> lock(mtx);
+        bool held = !segmentPath.empty() && !ec && heldBytes + size <= bufferBytes;
+        if(held) {
+            heldBytes += size;
+            peakHeldBytes = max(peakHeldBytes, heldBytes);
+            lock.unlock();
+            ifstream in(segmentPath, ios::binary);
+            segment.data.resize(size);
+            in.read(segment.data.data(), size);
+            segment.path.clear();
+            remove(segmentPath.c_str());
+            lock.lock();
+        }
+        pending[firstIndex] = std::move(segment);
+        ready.notify_one();
+    }
+
+    /**
+     *  @name finish
+     *  @brief stream the windows left, after any missing one, and close the stream
+     *
+     */
+    void finish() {
+        if(!enabled)
+            return;
+        {
+            std::lock_guard<std::mutex> lock(mtx);
+            finishing = true;
+        }
+        ready.notify_one();
+        if(writer.joinable())
+            writer.join();
+        if(outFd >= 0)
+            close(outFd);
+        if(listenFd >= 0)
+            close(listenFd);
+        outFd = listenFd = -1;
+        enabled = false;
+    }
+
+    void print() const {
+        if(target.empty()) return;
+        cout << " ****** Live stream " << target << ": " << streamed << " windows (MB): " << streamedBytes / 1048576.0
+             << ", dropped without viewer: " << dropped << ", held in memory max (MB): " << peakHeldBytes / 1048576.0
+             << ", waited on disk: " << spilled << "\n";
+    }
+
+private:
+
+    void run() {
+        std::unique_lock<std::mutex> lock(mtx);
+        while(true) {
+            ready.wait(lock, [this] { return finishing || pending.count(nextIndex) > 0; });
+            auto it = pending.find(nextIndex);
+            if(it == pending.end()) {
+                if(pending.empty())
+                    break;
+                it = pending.begin();   // a window is missing, the job is over
+            }
+            Segment segment = std::move(it->second);
+            nextIndex = it->first + segment.frames;
+            pending.erase(it);
+            heldBytes -= segment.data.size();
+            lock.unlock();
+
+            if(!segment.path.empty())
+                spilled++;
+            if(!segment.path.empty() || !segment.data.empty()) {
+                if(!connect())
+                    dropped++;
+                else if(send(segment))
+                    streamed++;
+                else {
+                    printf(" --- Live stream viewer gone\n");
+                    close(outFd);
+                    outFd = -1;
+                    dropped++;
+                }
+            }
+            if(!segment.path.empty())
+                remove(segment.path.c_str());
+            lock.lock();
+        }
+    }
+
+    // a viewer is waiting on the socket or the FIFO, never blocks
+    bool connect() {
+        if(outFd >= 0)
+            return true;
+        if(listenFd >= 0)
+            outFd = accept4(listenFd, nullptr, nullptr, SOCK_CLOEXEC);
+        else if(fifo && (outFd = ::open(target.c_str(), O_WRONLY | O_NONBLOCK | O_CLOEXEC)) >= 0)
+            fcntl(outFd, F_SETFL, 0);
+        if(outFd >= 0)
+            printf(" --- Live stream viewer connected\n");
+        return outFd >= 0;
+    }
+
+    bool send(const Segment &segment) {
+        if(!segment.data.empty()) {
+            for(size_t offset = 0; offset < segment.data.size();) {
+                ssize_t n = write(outFd, segment.data.data() + offset, segment.data.size() - offset);
+                if(n < 0 && errno == EINTR)
+                    continue;
+                if(n <= 0)
+                    return false;
+                offset += n;
+            }
+            streamedBytes += segment.data.size();
+            return true;
+        }
+
+        int in = ::open(segment.path.c_str(), O_RDONLY | O_CLOEXEC);
+        struct stat st;
+        bool sent = in >= 0 && fstat(in, &st) == 0;
+        off_t offset = 0;
+        while(sent && offset < st.st_size) {
+            ssize_t n = sendfile(outFd, in, &offset, st.st_size - offset);
+            if(n < 0 && errno == EINTR)
+                continue;
+            sent = n > 0;
+        }
+        if(in >= 0)
+            close(in);
+        if(sent)
+            streamedBytes += st.st_size;
+        return sent;
+    }
+};
+
+LiveStream liveStream;
@@ -0,0 +1,187 @@
+/**
+ *  @file    memoryAdmission.cpp
+ *  @author  Biniam Abrha Nigusse
+ *  @date    19/10/2026
+ *
+ *  @brief admission of the encoders within a memory budget, from an estimate of their peak
+ *  resident size refined with the rusage of the completed ones
+ *
+ */
+
+#include <map>
+#include <mutex>
+#include <condition_variable>
+#include <chrono>
+#include <algorithm>
+
+#define ENCODER_BASE_BYTES (64L << 20)   // ffmpeg, codec contexts and input decoding
+
+
+/**
+ *  @name MemoryTicket
+ *  @brief memory reserved for one encoder
+ *
+ */
+struct MemoryTicket {
+    long bytes = 0;
+    long estimated = 0;     // before the correction of the preset
+    string preset;
+    int threads = 0;
+};
+
+/**
+ *  @name MemoryAdmission
+ *  @brief an encoder starts only while the estimates of the running ones plus its own stay
+ *  within the budget, otherwise its window waits. The estimate counts the frames x264 keeps
+ *  for a preset (lookahead, references with their subpel planes, frame threads); the ratio
+ *  between the measured peak and the estimate is learnt per preset, increases are taken at
+ *  once and decreases slowly. A single encoder is always admitted.
+ *
+*/
+class MemoryAdmission {
+private:
+    std::mutex mtx;
+    std::condition_variable cv;
+    long budget = 0;
+    long used = 0;
+    long peak = 0;
+    int running = 0;
+    int height = 0;
+    map<string, double> correction;
+    int queued = 0;
+    long waitedMs = 0;
+
+public:
+
+    void start(long budgetMB) {
+        std::lock_guard<std::mutex> lock(mtx);
+        budget = budgetMB << 20;
+    }
+
+    bool isEnabled() const { return budget > 0; }
+
+    // height of the frames, known once the first frame arrived
+    void setHeight(int frameHeight) {
+        std::lock_guard<std::mutex> lock(mtx);
+        if(height == 0 && frameHeight > 0)
+            height = frameHeight;
+    }
+
+    bool hasHeight() {
+        std::lock_guard<std::mutex> lock(mtx);
+        return height > 0;
+    }
+
+    /**
+     *  @name admit
+     *  @brief reserve the memory of an encoder, waiting for running ones to exit if needed
+     *  @return MemoryTicket to give back with release
+     *
+     */
+    MemoryTicket admit(const string &preset, int threads) {
+        std::unique_lock<std::mutex> lock(mtx);
+        MemoryTicket ticket{0, 0, preset, threads};
+        if(budget == 0)
+            return ticket;
+
+        estimate(ticket);
+        if(running > 0 && used + ticket.bytes > budget) {
+            queued++;
+            auto start = std::chrono::steady_clock::now();
+            cv.wait(lock, [&] { return running == 0 || used + ticket.bytes <= budget; });
+            waitedMs += std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now() - start).count();
+        }
+        reserve(ticket);
+        return ticket;
+    }
+
+    /**
+     *  @name tryAdmit
+     *  @brief reserve the memory of an encoder without waiting
+     *  @return boolean value, true if admitted
+     *
+     */
+    bool tryAdmit(const string &preset, int threads, MemoryTicket &ticket) {
+        std::lock_guard<std::mutex> lock(mtx);
+        ticket = {0, 0, preset, threads};
+        if(budget == 0)
+            return true;
+
+        estimate(ticket);
+        if(running > 0 && used + ticket.bytes > budget)
+            return false;
+        reserve(ticket);
+        return true;
+    }
+
+    /**
+     *  @name release
+     *  @brief give back the memory of an exited encoder, its peak resident size in KB
+     *  (ru_maxrss, 0 if unknown) refines the estimates of its preset
+     *
+     */
+    void release(MemoryTicket &ticket, long maxRssKB) {
+        std::lock_guard<std::mutex> lock(mtx);
+        if(ticket.bytes == 0)
+            return;
+
+        used -= ticket.bytes;
+        running--;
+        if(maxRssKB > 0) {
+            double ratio = maxRssKB * 1024.0 / ticket.estimated;
+            if(!correction.count(ticket.preset))
+                correction[ticket.preset] = ratio;
+            double &c = correction[ticket.preset];
+            c = ratio > c ? ratio : 0.9 * c + 0.1 * ratio;
+        }
+        ticket.bytes = 0;
+        cv.notify_all();
+    }
+
+    void print() {
+        std::lock_guard<std::mutex> lock(mtx);
+        if(budget == 0) return;
+        cout << " ****** Memory budget (MB): " << (budget >> 20) << ", peak reserved (MB): " << (peak >> 20)
+             << ", windows queued for memory: " << queued << " (" << waitedMs << " ms)\n";
+    }
+
+private:
+    void reserve(const MemoryTicket &ticket) {
+        used += ticket.bytes;
+        running++;
+        peak = max(peak, used);
+    }
+
+    double correctionOf(const string &preset) {
+        auto it = correction.find(preset);
+        return it == correction.end() ? 1.0 : it->second;
+    }
+
+    // peak resident size of an x264 encoder, corrected with what was learnt for its preset
+    void estimate(MemoryTicket &ticket) {
+        static const map<string, pair<int, int>> framesKept = {
+                // preset: rc lookahead, reference frames
+                {"ultrafast", {0, 1}},
+                {"superfast", {0, 1}},
+                {"veryfast",  {10, 1}},
+                {"faster",    {20, 2}},
+                {"fast",      {30, 2}},
+                {"medium",    {40, 3}},
+                {"slow",      {50, 5}},
+                {"slower",    {60, 8}},
+                {"veryslow",  {60, 16}}
+        };
+        auto kept = framesKept.count(ticket.preset) ? framesKept.at(ticket.preset) : make_pair(40, 3);
+
+        double h = height > 0 ? height : 1080;
+        double luma = h * h * 16 / 9;
+        // 4:2:0 frames in flight, references also keep their half-pel planes
+        double bytes = ENCODER_BASE_BYTES +
+                       luma * 1.5 * (kept.first + 3 + max(1, ticket.threads)) +
+                       luma * 4.5 * kept.second;
+        ticket.estimated = long(bytes);
+        ticket.bytes = long(bytes * correctionOf(ticket.preset));
+    }
+};
+
+MemoryAdmission memoryAdmission;
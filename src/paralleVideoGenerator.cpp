@@ -9,10 +9,32 @@
 
 #include <fstream>
 #include <sys/inotify.h>
+#include <poll.h>
 #include <cstdlib>
 #include <sys/stat.h>
+#include <csignal>
+#include <mutex>
+#include <sys/resource.h>
 
+#include "sceneDetect.cpp"
+#include "costModel.cpp"
 #include "frameWindows.cpp"
+#include "frameTransport.cpp"
+#include "segmentSink.cpp"
+#include "frameHash.cpp"
+#include "segmentCache.cpp"
+#include "segmentStore.cpp"
+#include "rateAllocator.cpp"
+#include "presetScheduler.cpp"
+#include "straggler.cpp"
+#include "tailBalancer.cpp"
+#include "frameLocality.cpp"
+#include "autoTuner.cpp"
+#include "cpuPlacement.cpp"
+#include "colocation.cpp"
+#include "jobJournal.cpp"
+#include "streamManifest.cpp"
+#include "liveStream.cpp"
 
 #define EVENT_SIZE  ( sizeof (struct inotify_event) )
 #define BUF_LEN     ( 1024 * ( EVENT_SIZE + NAME_MAX + 1) )
@@ -27,6 +49,12 @@ using namespace ff;
 
 typedef  vector<int> ff_task_t;
 unsigned int numFrames;
+// guards the lists of partial outputs filled concurrently by the workers
+std::mutex outputPathsMutex;
+// progressive preview built in window order while the master windows encode
+OrderedSegmentSink proxySink;
+// niceness of the master encoders when a preview has to be served first
+const int MASTER_NICENESS = 10;
 
 #ifdef min
 #undef min //MD workaround to avoid clashing with min macro in minwindef.h
@@ -43,15 +71,25 @@ struct Reader: ff_node_t<ff_task_t> {
             int numWorkers,
             int tot_frames,
             int &emitter_time,
-            int &firstWindow_time
+            int &firstWindow_time,
+            const string &inputFile,
+            const ConverterOptions &opts
     ):
             inputPath(inputPath),
             numWorkers(numWorkers),
             tot_frames(tot_frames),
             emitter_time(emitter_time),
-            firstWindow_time(firstWindow_time)
+            firstWindow_time(firstWindow_time),
+            inputFile(inputFile),
+            opts(opts)
     {};
 
+    int svc_init() {
+        // the emitter keeps a core of its own, off the cores of the encoders
+        cpuPlacement.bindEmitter();
+        return 0;
+    }
+
     ff_task_t *svc(ff_task_t *) {
         // set window size equal to chuck size of workers
         const int winsize = int(tot_frames/numWorkers);
@@ -70,6 +108,49 @@ struct Reader: ff_node_t<ff_task_t> {
         // init window
         FrameWindows window(winsize);
 
+        // windows snapped to scene cuts, the frames around the nominal boundaries are analysed
+        std::unique_ptr<SceneWindows> sceneWindows;
+        if(opts.sceneCuts)
+            sceneWindows = make_unique<SceneWindows>(winsize, tot_frames, opts.sceneTolerance, opts.sceneThreshold,
+                    [this](int fno) { return lumaHistogram(frameFilename(inputFile, fno)); });
+
+        // windows sized by estimated encode cost, frames are sampled as the prefix grows
+        std::unique_ptr<CostWindows> costWindows;
+        if(opts.costWindows)
+            costWindows = make_unique<CostWindows>(winsize, tot_frames, opts.costSample, costModel,
+                    [this](int fno) { return lumaThumbnail(frameFilename(inputFile, fno)); });
+
+        std::function<std::vector<std::vector<int>>(const std::string &)> adaptiveWindows;
+        if(sceneWindows)
+            adaptiveWindows = [&](const std::string &name) { return sceneWindows->addframe(name); };
+        else if(costWindows)
+            adaptiveWindows = [&](const std::string &name) { return costWindows->addframe(name); };
+
+        int framesDispatched = 0;
+        auto dispatch = [&](const vector<int> &window) {
+            // with a locality manifest a window never spans two render nodes
+            for(auto &frames : frameLocality.isEnabled() ? frameLocality.split(window) : vector<vector<int>>{window}) {
+                // the frames of a window no other one follows can go to the idle workers
+                framesDispatched += frames.size();
+                vector<vector<int>> windows = tailBalancer.split(frames, tot_frames - framesDispatched, winsize);
+                if(windows.size() > 1) {
+                    printf( " --- Tail window [%d-%d] split in %d\n", frames.front(), frames.back(), int(windows.size()) );
+                    costModel.dropWindow(frames.front());
+                }
+                for(auto &w : windows) {
+                    ff_task_t *t = new ff_task_t(w);
+                    ff_send_out(t); // sends the task t to workers
+                }
+            }
+
+            if( !windTimeSet ) {
+                windTimeSet = true;
+                auto firstWindowElapsed = std::chrono::high_resolution_clock::now() - start;
+                auto firstWindowElapsed_msec = std::chrono::duration_cast<std::chrono::milliseconds>(firstWindowElapsed).count();
+                firstWindow_time = firstWindowElapsed_msec;
+            }
+        };
+
         fd = inotify_init();
 
         if ( fd < 0 ) {
@@ -81,6 +162,18 @@ struct Reader: ff_node_t<ff_task_t> {
         printf(" --- Started watching folder ...\n");
 
         while(true) {
+            // a window that failed for good stops the job, no more windows are sent
+            struct pollfd watch = {fd, POLLIN, 0};
+            bool events = poll(&watch, 1, 200) > 0;
+            if(encodeFailures.aborted()) {
+                (void) inotify_rm_watch(fd, wd);
+                (void) close(fd);
+                printf(" --- Stopped reading after %d files, the job failed\n", count);
+                return EOS;
+            }
+            if(!events)
+                continue;
+
             length = read( fd, buffer, BUF_LEN );
 
             if ( length < 0 ) {
@@ -99,7 +192,14 @@ struct Reader: ff_node_t<ff_task_t> {
                                 timeSet = true;
                                 start  = std::chrono::high_resolution_clock::now();
                             }
-                            if( regex_match (event->name, base_regex )) {
+                            if( regex_match (event->name, base_regex ) && adaptiveWindows) {
+                                for(auto &frames : adaptiveWindows(event->name)) {
+                                    printf( " Window [%d-%d]  completed.\n", frames.front(), frames.back() );
+                                    dispatch(frames);
+                                }
+                                count++;
+                            }
+                            else if( regex_match (event->name, base_regex )) {
                                 int wno = window.addframe(event->name);
                                 bool complete = window.iscomplete(wno);
                                 // std::cout << event->name << "\twno=" << wno << "\tcomplete=" << complete << '\n';
@@ -107,16 +207,7 @@ struct Reader: ff_node_t<ff_task_t> {
                                     v = window.flush(wno);
                                    // printwin(wno, v);
                                     printf( " Window [%d]  completed.\n", wno );
-                                    ff_task_t *t = new ff_task_t(v);
-                                    ff_send_out(t); // sends the task t to workers
-
-                                    if( !windTimeSet ) {
-                                        windTimeSet = true;
-                                        auto firstWindowElapsed = std::chrono::high_resolution_clock::now() - start;
-                                        auto firstWindowElapsed_msec = std::chrono::duration_cast<std::chrono::milliseconds>(firstWindowElapsed).count();
-                                        firstWindow_time = firstWindowElapsed_msec;
-                                    }
-
+                                    dispatch(v);
                                 }
 
                                 count++;
@@ -137,6 +228,8 @@ struct Reader: ff_node_t<ff_task_t> {
                     (void) close(fd);
 
                     printf(" --- Finished reading %d files ... \n", tot_frames);
+                    if(sceneWindows)
+                        printf(" --- Windows snapped to %d scene cuts\n", sceneWindows->sceneCuts());
 
                     return EOS;
                 }
@@ -149,6 +242,8 @@ struct Reader: ff_node_t<ff_task_t> {
     int numWorkers;
     int &emitter_time;
     int &firstWindow_time;
+    const string &inputFile;
+    const ConverterOptions &opts;
 };
 
 struct Worker : ff_node_t<ff_task_t> {
@@ -160,12 +255,13 @@ struct Worker : ff_node_t<ff_task_t> {
             int numWorker,
             int threads,
             stringVec &tmpOutputPathNames,
-            map<pid_t, int> &pid2part,
-            map<int, pid_t> &part2pid,
+            vector<stringVec> &renditionPathNames,
+            PartQueue &completedParts,
             bool re_encode,
             const string &tmpOutputDir,
             const string &finalOutputPath,
-            int framerate
+            int framerate,
+            const ConverterOptions &opts
     ):
             inputFile(inputFile),
             outputFilename(outputFilename),
@@ -173,17 +269,33 @@ struct Worker : ff_node_t<ff_task_t> {
             numWorker(numWorker),
             threads(threads),
             tmpOutputPathNames(tmpOutputPathNames),
-            pid2part(pid2part),
-            part2pid(part2pid),
+            renditionPathNames(renditionPathNames),
+            completedParts(completedParts),
             re_encode(re_encode),
             tmpOutputDir(tmpOutputDir),
             finalOutputPath(finalOutputPath),
-            framerate(framerate)
+            framerate(framerate),
+            opts(opts)
 
 
     {};
 
+    int svc_init() {
+        // the encoders forked by this worker inherit its cores and memory node
+        if(cpuPlacement.isEnabled()) {
+            cpuPlacement.bindWorker(startIndex);
+            printf(" --- WORKER [%d] : placed on %s\n", startIndex, cpuPlacement.describe(startIndex).c_str());
+        }
+        return 0;
+    }
+
     ff_task_t *svc(ff_task_t *in) {
+        // the job failed, the windows left are not encoded
+        if(encodeFailures.aborted()) {
+            delete in;
+            return GO_ON;
+        }
+
         ff_task_t &inImg = *in;
         int firstIndex = inImg[0];
         int lastIndex = inImg[inImg.size() - 1];
@@ -192,48 +304,408 @@ struct Worker : ff_node_t<ff_task_t> {
 
         printf(" --- WORKER [%d] : started with frame index [%d] ...\n", startIndex, firstIndex);
 
-        if(re_encode) {
-           // printf(" --- WORKER started with frame index [%d] - enabling re-encoding ...\n", firstIndex);
-            string tmpOutput= tmpOutputDir + "tmp_" + to_string(startIndex) + "_" + outputFilename + ".mov";
-            tmpOutputPathNames.push_back(tmpOutput);
+        // runs of identical frames are encoded once from a list carrying their durations
+        string frameSource = inputFile;
+        int encodedFrames = chunkSize;
+        vector<int> sourceFrames = inImg;
+        if(opts.dedup) {
+            vector<pair<int, int>> runs = duplicateRuns(inputFile, inImg);
+            string listPath = tmpOutputDir + "frames_" + to_string(firstIndex) + "_" + outputFilename + ".ffconcat";
+            int listed = int(runs.size()) < chunkSize ? writeConcatList(listPath, inputFile, runs, framerate) : 0;
+            if(listed > 0 && listed < chunkSize) {
+                frameSource = listPath;
+                encodedFrames = listed;
+                sourceFrames.clear();
+                for(auto &run : runs)
+                    sourceFrames.push_back(run.first);
+                printf(" --- WORKER [%d] : %d duplicate frames skipped\n", startIndex, chunkSize - encodedFrames);
+            }
+        }
 
-            imageConverterReduce(
-                    inputFile,
-                    tmpOutput,
-                    "mp4",
-                    numWorker,
-                    inImg.size(),
-                    false,
+        // with the pipe transport the encoder reads the frames from a ring fed by this worker,
+        // a list of frames with durations is always read by the encoder itself
+        FramePipe ring, proxyRing;
+        int inputFd = -1;
+        int proxyFd = -1;
+        if(opts.transport == "pipe" && frameSource == inputFile && ring.open(size_t(opts.ringSizeMB) << 20))
+            inputFd = ring.readEnd();
+        if(opts.proxyHeight > 0 && inputFd >= 0 && proxyRing.open(size_t(opts.ringSizeMB) << 20))
+            proxyFd = proxyRing.readEnd();
+
+        // the encoders of the window take their threads from the cpu tokens, a single grant for
+        // the master and its preview; the encoders of the tail of the job also get the threads
+        // of the idle workers
+        int encoderThreads = tailBalancer.threads(threads);
+        int proxyThreads = opts.proxyHeight > 0 ? threads : 0;
+        int granted = cpuTokens.acquire(encoderThreads + proxyThreads, proxyThreads > 0 ? 2 : 1);
+        if(proxyThreads > 0)
+            proxyThreads = min(granted, max(1, min(proxyThreads, granted - encoderThreads)));
+        int masterTokens = granted - proxyThreads;
+        encoderThreads = max(1, masterTokens);
+
+        // the preview of the window starts first, the master is niced below it
+        pid_t proxyPid = -1;
+        string proxyOutput;
+        if(opts.proxyHeight > 0) {
+            proxyOutput = tmpOutputDir + "proxy_" + to_string(firstIndex) + "_" + outputFilename + ".ts";
+            proxyPid = proxyConverter(
+                    frameSource,
+                    proxyOutput,
                     inputParams,
                     to_string(framerate),
-                    chunkSize,
-                    to_string(threads),
-                    pid2part,
-                    part2pid,
-                    startIndex
+                    encodedFrames,
+                    to_string(max(1, proxyThreads)),
+                    opts.proxyHeight,
+                    opts.proxyFps,
+                    proxyFd
             );
-
         }
+
+        // partial outputs of this window, the analysis pass of a target size job only measures it;
+        // the fragments of a streaming output are published as they are
+        stringVec tmpOutputs;
+        bool analysis = opts.targetSizeMB > 0;
+        bool streaming = streamManifest.isOpen();
+        string passLog = tmpOutputDir + "pass_" + windowTag(firstIndex);
+        SegmentPlacement placement{tmpOutputDir, 0};
+        if(!analysis && !re_encode && !streaming)
+            placement = segmentStore.place(tmpOutputDir, chunkSize, max<size_t>(1, opts.renditions.size()));
+        if(analysis)
+            tmpOutputs.push_back(tmpOutputDir + "analysis_" + windowTag(firstIndex) + "_" + outputFilename);
+        else if(re_encode)
+            tmpOutputs.push_back(tmpOutputDir + "tmp_" + to_string(startIndex) + "_" + outputFilename + ".mov");
+        else if(streaming)
+            for(size_t o = 0; o < max<size_t>(1, opts.renditions.size()); o++)
+                tmpOutputs.push_back(streamManifest.segmentPath(firstIndex, o));
+        else if(!opts.renditions.empty())
+            for(auto &rendition : opts.renditions)
+                tmpOutputs.push_back(placement.dir + windowTag(firstIndex) + "_" + renditionFilename(outputFilename, rendition));
         else
-            {
-            //printf(" --- WORKER started with frame index [%d] - disabling re-encoding ...\n", firstIndex);
-            string tmpOutput= tmpOutputDir + to_string(startIndex) + "_" + outputFilename;
-            tmpOutputPathNames.push_back(tmpOutput);
+            tmpOutputs.push_back(placement.dir + windowTag(firstIndex) + "_" + outputFilename);
+        if(!analysis && !streaming) {
+            std::lock_guard<std::mutex> lock(outputPathsMutex);
+            if(opts.renditions.empty() || re_encode)
+                tmpOutputPathNames.push_back(tmpOutputs[0]);
+            else
+                for(size_t r = 0; r < tmpOutputs.size(); r++)
+                    renditionPathNames[r].push_back(tmpOutputs[r]);
+        }
+
+        // the deadline picks the preset of every window, re-evaluated as the job progresses
+        string preset = re_encode ? "veryslow" : "medium";
+        if(presetScheduler.isEnabled() && !analysis) {
+            preset = presetScheduler.choose(preset);
+            printf(" --- WORKER [%d] : window [%d-%d] preset %s\n", startIndex, firstIndex, lastIndex, preset.c_str());
+        }
+
+        // the windows completed before the job was interrupted are verified and reused
+        bool cached = false;
+        bool journaled = jobJournal.isEnabled() && !analysis;
+        if(journaled) {
+            cached = jobJournal.recover(firstIndex, chunkSize, tmpOutputs);
+            if(cached)
+                printf(" --- WORKER [%d] : window [%d-%d] recovered from the journal\n", startIndex, firstIndex, lastIndex);
+            else
+                jobJournal.dispatch(firstIndex, chunkSize, tmpOutputs);
+        }
+        bool recovered = cached;
+
+        // unchanged windows reuse the segments encoded by a previous job
+        string cacheKey;
+        if(segmentCache.enabled() && !analysis && !cached) {
+            string params = preset + "|" + to_string(framerate) + "|" +
+                            to_string(encodedFrames) + "|" + (frameSource == inputFile ? "cfr" : "vfr");
+            // a segment is only reused by a job writing the same container in the same mode
+            string extension = tmpOutputs.empty() ? "" : fs::path(tmpOutputs[0]).extension().string();
+            transform(extension.begin(), extension.end(), extension.begin(), ::tolower);
+            params += "|" + extension + "|" + (re_encode ? "re_encode" : analysis ? "analysis" : "window");
+            // fragments carry the position of the window in the stream
+            if(streaming)
+                params += "|cmaf:" + to_string(firstIndex) + ":" + to_string(opts.cmafGop);
+            for(auto &rendition : opts.renditions)
+                params += "|" + rendition.name() + ":" + rendition.bitrate;
+            cacheKey = segmentCache.key(windowHash(inputFile, inImg), params);
+            cached = segmentCache.fetch(cacheKey, tmpOutputs, chunkSize);
+            if(cached)
+                printf(" --- WORKER [%d] : window [%d-%d] reused from cache\n", startIndex, firstIndex, lastIndex);
+        }
 
-            imageConverter(
-                    inputFile,
-                    tmpOutput,
+        // with a locality manifest the window goes to the node holding its frames
+        const FrameRange *located = analysis || re_encode || !opts.renditions.empty() ? nullptr :
+                                    frameLocality.owner(firstIndex, lastIndex);
+
+        // the local encoders write unlinked files, named once the encoder exited; the outputs
+        // of a speculative duplicate are renamed in place instead
+        bool staged = !cached && !analysis && !re_encode && located == nullptr &&
+                      (opts.nodes.empty() || frameSource != inputFile) && !stragglerMonitor.isEnabled();
+        StagedOutputs staging;
+        auto encoderOutputs = [&]() -> stringVec {
+            if(!staged)
+                return tmpOutputs;
+            staging = stageOutputs(tmpOutputs);
+            segmentStore.stage(!staging.fds.empty());
+            return staging.paths;
+        };
+
+        // fragments start on keyframes at the same frames in every rendition
+        stringVec outputOptions;
+        if(streaming)
+            outputOptions = cmafOutputArgs(firstIndex, framerate, opts.cmafGop > 0 ? opts.cmafGop : 2 * framerate);
+        // the /proc name of a staged output does not tell ffmpeg its container
+        string container = containerFormat(tmpOutputs.empty() ? "" : tmpOutputs[0]);
+        if(staged && !streaming && container.empty())
+            staged = false;
+        else if(staged && !streaming)
+            outputOptions.insert(outputOptions.end(), {"-f", container});
+        if(staged)
+            outputOptions.push_back("-y");
+
+        // the encoder of the window, spawned again from the frame files for a speculative duplicate
+        auto spawnEncoder = [&](const stringVec &outputs, int fd, int encoderThreads) -> pid_t {
+            if(analysis) {
+                return twoPassConverter(
+                        frameSource,
+                        outputs[0],
+                        inputParams,
+                        to_string(framerate),
+                        encodedFrames,
+                        to_string(encoderThreads),
+                        1,
+                        passLog,
+                        0,
+                        fd
+                );
+            }
+            else if(re_encode) {
+               // printf(" --- WORKER started with frame index [%d] - enabling re-encoding ...\n", firstIndex);
+                return imageConverterReduce(
+                        frameSource,
+                        outputs[0],
+                        "mp4",
+                        numWorker,
+                        inImg.size(),
+                        false,
+                        inputParams,
+                        to_string(framerate),
+                        encodedFrames,
+                        to_string(encoderThreads),
+                        fd,
+                        preset
+                );
+            }
+            else if(!opts.renditions.empty()) {
+                // one encoder process per window, one output per rendition
+                return renditionConverter(
+                        frameSource,
+                        outputs,
+                        inputParams,
+                        to_string(framerate),
+                        encodedFrames,
+                        to_string(encoderThreads),
+                        opts.renditions,
+                        fd,
+                        preset,
+                        outputOptions
+                );
+            }
+            // the node which rendered the frames of the window encodes them from its disk
+            if(located != nullptr) {
+                return remoteConverter(
+                        located->endpoint,
+                        located->pattern,
+                        outputs[0],
+                        inputParams,
+                        to_string(framerate),
+                        encodedFrames,
+                        to_string(encoderThreads),
+                        preset,
+                        false
+                );
+            }
+            // the encoder node of this worker returns the segment, lists of frames stay local
+            if(!opts.nodes.empty() && frameSource == inputFile) {
+                return remoteConverter(
+                        opts.nodes[startIndex % opts.nodes.size()],
+                        frameSource,
+                        outputs[0],
+                        inputParams,
+                        to_string(framerate),
+                        encodedFrames,
+                        to_string(encoderThreads),
+                        preset,
+                        opts.shipFrames
+                );
+            }
+            //printf(" --- WORKER started with frame index [%d] - disabling re-encoding ...\n", firstIndex);
+            return imageConverter(
+                    frameSource,
+                    outputs[0],
                     "mp4",
                     numWorker,
                     inImg.size(),
                     false,
                     inputParams,
                     to_string(framerate),
-                    chunkSize,
-                    to_string(threads)
+                    encodedFrames,
+                    to_string(encoderThreads),
+                    fd,
+                    preset,
+                    outputOptions
             );
+        };
+
+        // the window waits here until the memory of its encoder fits the budget, the cpu tokens
+        // of its master are given back meanwhile for the running encoders to use
+        MemoryTicket memory;
+        if(!cached && memoryAdmission.isEnabled()) {
+            // the height is read once, an ffprobe for anything but a PNG
+            if(!memoryAdmission.hasHeight())
+                memoryAdmission.setHeight(frameHeight(frameFilename(inputFile, firstIndex)));
+            if(!memoryAdmission.tryAdmit(preset, encoderThreads, memory)) {
+                cpuTokens.release(masterTokens);
+                memory = memoryAdmission.admit(preset, encoderThreads);
+                masterTokens = cpuTokens.acquire(encoderThreads);
+                encoderThreads = max(1, masterTokens);
+            }
+        }
+
+        auto encodeStart = std::chrono::high_resolution_clock::now();
+        pid_t pid = -1;
+        if(!cached) {
+            pid = spawnEncoder(encoderOutputs(), inputFd, encoderThreads);
+            if(pid > 0)
+                stragglerMonitor.begin();
+        }
+
+        // in background every encoder already runs at idle priority
+        if(proxyPid > 0 && pid > 0 && !opts.background)
+            setpriority(PRIO_PROCESS, pid, MASTER_NICENESS);
+
+        // a master which may be speculated on is fed by a thread of its own, so that its
+        // progress is tracked while the ring is full
+        std::thread feeder;
+        if(inputFd >= 0) {
+            ring.closeRead();
+            proxyRing.closeRead();
+            // the preview is fed first so that it never waits on the backpressure of the master,
+            // the frames are then spliced again to the master from the page cache
+            if(proxyFd >= 0) {
+                for(int fno : inImg) {
+                    if(!proxyRing.sendFile(frameFilename(inputFile, fno), transportStats))
+                        break; // encoder exited
+                }
+                proxyRing.closeWrite();
+            }
+            auto feed = [&, pid] {
+                for(int fno : inImg) {
+                    if(pid <= 0 || !ring.sendFile(frameFilename(inputFile, fno), transportStats))
+                        break; // encoder exited
+                }
+                ring.closeWrite();
+            };
+            if(pid > 0 && stragglerMonitor.isEnabled() && !analysis)
+                feeder = std::thread(feed);
+            else
+                feed();
+        }
+
+        if(proxyPid > 0) {
+            int proxy_status;
+            waitpid(proxyPid, &proxy_status, 0);
+            cpuTokens.release(proxyThreads);
+            if(proxySink.add(firstIndex, chunkSize, proxyOutput) > 0)
+                printf(" --- Proxy extended with window starting at frame [%d]\n", firstIndex);
+        }
+
+        struct rusage usage = {};
+        int status = cached ? 0 : -1;
+        if(pid > 0) {
+            // the pass 1 of a target size job shares its log file, it is never duplicated
+            if(stragglerMonitor.isEnabled() && !analysis)
+                status = waitSpeculative(pid, tmpOutputs, sourceBytes(inputFile, sourceFrames), chunkSize, encodeStart,
+                                         spawnEncoder, preset, &usage);
+            else
+                status = waitChildProc(pid, &usage);
+        }
+        // the master has exited or was killed, its end of the ring is closed
+        if(feeder.joinable())
+            feeder.join();
+        if(staged)
+            linkOutputs(staging, tmpOutputs, status == 0);
+
+        // a failed encoder, or a broken segment, is encoded again by a new encoder reading the
+        // frame files; the window fails the job once its retries run out
+        string failure = cached ? "" : encodeFailure(status, tmpOutputs);
+        for(int attempt = 1; !failure.empty() && attempt <= encodeFailures.maxRetries() && !encodeFailures.aborted(); attempt++) {
+            printf(" --- WORKER [%d] : window [%d-%d] failed (%s), retry %d of %d\n", startIndex, firstIndex, lastIndex,
+                   failure.c_str(), attempt, encodeFailures.maxRetries());
+            encodeFailures.retry();
+            for(auto &output : tmpOutputs)
+                remove(output.c_str());
+            pid_t retry = spawnEncoder(encoderOutputs(), -1, encoderThreads);
+            status = retry > 0 ? waitChildProc(retry, &usage) : -1;
+            if(staged)
+                linkOutputs(staging, tmpOutputs, status == 0);
+            failure = encodeFailure(status, tmpOutputs);
+        }
+        if(!failure.empty())
+            encodeFailures.fail("window [" + to_string(firstIndex) + "-" + to_string(lastIndex) + "] of worker " +
+                                to_string(startIndex) + ": " + failure);
+
+        if(pid > 0) {
+            auto encodeElapsed = std::chrono::high_resolution_clock::now() - encodeStart;
+            long encode_msec = std::chrono::duration_cast<std::chrono::milliseconds>(encodeElapsed).count();
+            // a failed window is no reference for the speed of the others
+            stragglerMonitor.end(failure.empty() ? chunkSize : 0, encode_msec);
+            if(!cacheKey.empty() && failure.empty())
+                segmentCache.store(cacheKey, tmpOutputs, chunkSize, encode_msec);
+            if(opts.costWindows && failure.empty())
+                costModel.observe(firstIndex, chunkSize, encode_msec);
+            if(!analysis)
+                presetScheduler.complete(chunkSize, encode_msec, preset);
+        }
+        else if(cached) {
+            presetScheduler.complete(chunkSize, 0, preset);
+        }
+        cpuTokens.release(masterTokens);
+        memoryAdmission.release(memory, usage.ru_maxrss);
+        if(!analysis && !re_encode && !streaming)
+            segmentStore.settle(placement, chunkSize, tmpOutputs);
+
+        if(journaled && !recovered && failure.empty())
+            jobJournal.complete(firstIndex, chunkSize, tmpOutputs);
+
+        if(streaming && failure.empty() && streamManifest.add(firstIndex, chunkSize, tmpOutputs) > 0)
+            printf(" --- Stream extended with window starting at frame [%d]\n", firstIndex);
+
+        // the live stream gets the video of the window as MPEG-TS, fragments already carry their timestamps
+        if(liveStream.isOpen() && !analysis && !re_encode) {
+            string liveOutput = tmpOutputDir + "live_" + windowTag(firstIndex) + ".ts";
+            pid_t remux = failure.empty() ? streamConverter(tmpOutputs[0], liveOutput, streaming ? 0 : double(firstIndex) / framerate) : -1;
+            bool remuxed = remux > 0 && waitChildProc(remux) == 0;
+            liveStream.add(firstIndex, chunkSize, remuxed ? liveOutput : "");
+        }
+
+        if(located != nullptr && pid > 0 && failure.empty()) {
+            std::error_code ec;
+            uintmax_t bytes = fs::file_size(tmpOutputs[0], ec);
+            frameLocality.encoded(chunkSize, ec ? 0 : bytes);
         }
 
+        // the size of the constant quality encode measures the complexity of the window
+        if(analysis) {
+            std::error_code ec;
+            uintmax_t bytes = fs::file_size(tmpOutputs[0], ec);
+            rateAllocator.add({firstIndex, chunkSize, encodedFrames, frameSource, passLog, ec ? 0 : bytes});
+            fs::remove(tmpOutputs[0], ec);
+        }
+
+        // hand the partial output to the reduce tree
+        if(re_encode && failure.empty())
+            completedParts.push(startIndex);
+
+        tailBalancer.complete();
+
 
         delete in;
         return GO_ON;
@@ -241,21 +713,161 @@ struct Worker : ff_node_t<ff_task_t> {
 
     };
 
+    /**
+     *  @name waitSpeculative
+     *  @brief wait for the encoder of a window while tracking its progress. Once other workers
+     *  are idle and the encoder is projected to finish far behind its peers, a duplicate is
+     *  spawned from the frame files into spec_ outputs: the first to finish wins, the other
+     *  one is killed and its outputs removed. The duplicate needs free cpu tokens and memory.
+     *  @return exit status of the winner, -1 if it did not exit normally, its resource usage
+     *  in usage
+     *
+     */
+    int waitSpeculative(pid_t pid, const stringVec &outputs, uintmax_t inputBytes, int frames,
+                        std::chrono::high_resolution_clock::time_point encodeStart,
+                        const std::function<pid_t(const stringVec &, int, int)> &spawnEncoder,
+                        const string &preset, struct rusage *usage) {
+        pid_t duplicate = -1;
+        int duplicateTokens = 0;
+        MemoryTicket duplicateMemory;
+        struct rusage duplicateUsage = {};
+        bool speculated = false;
+        bool duplicateWon = false;
+        stringVec duplicateOutputs;
+        int status = 0;
+
+        while(true) {
+            if(pid > 0 && wait4(pid, &status, WNOHANG, usage) == pid) {
+                pid = 0;
+                // a failed encode still leaves the chance to the duplicate
+                if((WIFEXITED(status) && WEXITSTATUS(status) == 0) || duplicate <= 0)
+                    break;
+            }
+            if(duplicate > 0 && wait4(duplicate, &status, WNOHANG, &duplicateUsage) == duplicate) {
+                duplicate = 0;
+                cpuTokens.release(duplicateTokens);
+                duplicateTokens = 0;
+                memoryAdmission.release(duplicateMemory, 0);
+                if((WIFEXITED(status) && WEXITSTATUS(status) == 0) || pid <= 0) {
+                    *usage = duplicateUsage;
+                    duplicateWon = true;
+                    break;
+                }
+            }
+
+            if(!speculated && pid > 0) {
+                long elapsedMs = std::chrono::duration_cast<std::chrono::milliseconds>(
+                        std::chrono::high_resolution_clock::now() - encodeStart).count();
+                double progress = encoderProgress(pid, inputBytes);
+                // the duplicate only runs on free cpu tokens
+                if(stragglerMonitor.isStraggler(elapsedMs, progress, frames) &&
+                   (duplicateTokens = cpuTokens.tryAcquire(threads)) > 0) {
+                    if(!memoryAdmission.tryAdmit(preset, duplicateTokens, duplicateMemory)) {
+                        cpuTokens.release(duplicateTokens);
+                        duplicateTokens = 0;
+                        usleep(STRAGGLER_POLL_MS * 1000);
+                        continue;
+                    }
+                    speculated = true;
+                    for(auto &output : outputs)
+                        duplicateOutputs.push_back(tmpOutputDir + "spec_" + fs::path(output).filename().string());
+                    duplicate = spawnEncoder(duplicateOutputs, -1, duplicateTokens);
+                    printf(" --- WORKER [%d] : window at %.0f%% after %ld ms, speculative duplicate started\n",
+                           startIndex, progress * 100, elapsedMs);
+                }
+            }
+
+            usleep(STRAGGLER_POLL_MS * 1000);
+        }
+
+        pid_t loser = duplicateWon ? pid : duplicate;
+        if(loser > 0) {
+            kill(loser, SIGKILL);
+            waitpid(loser, nullptr, 0);
+        }
+        cpuTokens.release(duplicateTokens);
+        memoryAdmission.release(duplicateMemory, 0);
+
+        if(speculated) {
+            stragglerMonitor.speculated(duplicateWon);
+            for(size_t n = 0; n < outputs.size(); n++) {
+                std::error_code ec;
+                if(duplicateWon)
+                    fs::rename(duplicateOutputs[n], outputs[n], ec);
+                else
+                    fs::remove(duplicateOutputs[n], ec);
+            }
+            if(duplicateWon)
+                printf(" --- WORKER [%d] : speculative duplicate finished first\n", startIndex);
+        }
+
+        return WIFEXITED(status) ? WEXITSTATUS(status) : -1;
+    }
+
     const string &inputFile;
     const string &outputFilename;
     int startIndex;
     int numWorker;
     int threads;
     stringVec &tmpOutputPathNames;
-    map<pid_t, int> &pid2part;
-    map<int, pid_t> &part2pid;
+    vector<stringVec> &renditionPathNames;
+    PartQueue &completedParts;
     bool re_encode;
     const string &tmpOutputDir;
     const string &finalOutputPath;
     int framerate;
+    const ConverterOptions &opts;
 
 };
 
+/**
+ *  @name secondPass
+ *  @brief encode in parallel all the analysed windows at their allocated bitrate
+ *
+ */
+void secondPass(const vector<WindowAnalysis> &windows, int numWorker, int FFthreads, int framerate,
+                const string &tmpOutputDir, const string &outputFilename, stringVec &tmpOutputPathNames) {
+
+    printf(" --- Second pass of %zu windows ...\n", windows.size());
+
+    ParallelFor pf(numWorker);
+    pf.parallel_for(0, windows.size(), 1, 1, [&](const long i) {
+        const WindowAnalysis &w = windows[i];
+        printf(" --- Window [%d] encoding at %ld kb/s\n", w.firstFrame, w.bitrate / 1000);
+        string output = tmpOutputDir + windowTag(w.firstFrame) + "_" + outputFilename;
+        int threads = cpuTokens.acquire(FFthreads);
+        string failure;
+        for(int attempt = 0; attempt <= encodeFailures.maxRetries() && !encodeFailures.aborted(); attempt++) {
+            if(attempt > 0) {
+                printf(" --- Window [%d] failed (%s), retry %d of %d\n", w.firstFrame, failure.c_str(), attempt,
+                       encodeFailures.maxRetries());
+                encodeFailures.retry();
+            }
+            pid_t pid = twoPassConverter(
+                    w.frameSource,
+                    output,
+                    to_string(w.firstFrame),
+                    to_string(framerate),
+                    w.encodedFrames,
+                    to_string(max(1, threads)),
+                    2,
+                    w.passLog,
+                    w.bitrate
+            );
+            failure = encodeFailure(pid > 0 ? waitChildProc(pid) : -1, {output});
+            if(failure.empty())
+                break;
+        }
+        cpuTokens.release(threads);
+        if(!failure.empty())
+            encodeFailures.fail("window [" + to_string(w.firstFrame) + "-" + to_string(w.firstFrame + w.frames - 1) +
+                                "] of the second pass: " + failure);
+    }, numWorker);
+
+    for(auto &w : windows)
+        tmpOutputPathNames.push_back(tmpOutputDir + windowTag(w.firstFrame) + "_" + outputFilename);
+}
+
 /**
  *  @name parallelConverter
  *  @brief Function to manage the creation of workers and initialize the Emitter
@@ -264,7 +876,8 @@ struct Worker : ff_node_t<ff_task_t> {
  */
 int parallelConverter(const string& inputPath,const string& filename,const string& outputFilename,
                         const string& output_format,int numWorker, int tot_frames, bool skip_save,
-                        bool re_encode, int ffmpeg_thds, int framerate, bool hasAudio, const string& inputAudio){
+                        bool re_encode, int ffmpeg_thds, int framerate, bool hasAudio, const string& inputAudio,
+                        const ConverterOptions &opts){
 
 
     int numThreads = 1;
@@ -273,22 +886,103 @@ int parallelConverter(const string& inputPath,const string& filename,const strin
 
     string inputFile = inputPath + filename;
     stringVec tmpOutputPathNames;
+    vector<stringVec> renditionPathNames(opts.renditions.size());
 
-    const string tmpOutputDir = "./tmp/";
-    const string finalOutputPath = "./output/";
+    if(re_encode && !opts.renditions.empty())
+        printf(" --- Renditions are not supported with re-encoding, producing a single output\n");
+
+    const string tmpOutputDir = opts.tmpDir;
+    const string finalOutputPath = opts.outputDir;
 
     // create output directory if it doesn't exist.
-    mkdir(finalOutputPath.c_str(), S_IRWXU | S_IRWXG | S_IROTH | S_IXOTH);
-    mkdir(tmpOutputDir.c_str(), S_IRWXU | S_IRWXG | S_IROTH | S_IXOTH);
+    fs::create_directories(finalOutputPath);
+    fs::create_directories(tmpOutputDir);
+
+    // segments in memory until the merge, in a directory found again by a resumed job
+    if(opts.tmpRamMB > 0) {
+        string ramDir = "/dev/shm/iol_" + to_string(std::hash<string>()(fs::absolute(tmpOutputDir).string() + outputFilename));
+        if(!segmentStore.start(ramDir, opts.tmpRamMB))
+            printf(" --- /dev/shm not available, the segments are kept in %s\n", tmpOutputDir.c_str());
+    }
 
     int FFthreads = ffmpeg_thds == 0 ? getFFThreads(numWorker): ffmpeg_thds;
     //cout<< "FFThreads " << FFthreads <<endl;
 
-    std::map<pid_t, int> pid2part;
-    std::map<int, pid_t> part2pid;
+    PartQueue completedParts;
+
+    if(!opts.cacheDir.empty())
+        segmentCache.open(opts.cacheDir, opts.cacheSizeMB);
+
+    if(opts.deadlineSec > 0)
+        presetScheduler.start(opts.deadlineSec, tot_frames, numWorker);
+
+    if(opts.speculateFactor > 0)
+        stragglerMonitor.start(opts.speculateFactor, numWorker);
+
+    if(opts.tailSplit)
+        tailBalancer.start(numWorker);
+
+    if(opts.cpuBudget >= 0)
+        cpuTokens.start(opts.cpuBudget > 0 ? opts.cpuBudget : thread::hardware_concurrency());
+
+    if(opts.placement)
+        cpuPlacement.start(numWorker);
+
+    if(opts.memBudgetMB > 0)
+        memoryAdmission.start(opts.memBudgetMB);
+
+    encodeFailures.start(opts.retries);
+
+    if(!opts.localityManifest.empty() && !frameLocality.load(opts.localityManifest))
+        printf(" --- No frame range in %s, the windows are encoded as usual\n", opts.localityManifest.c_str());
+
+    // the parts of a re-encoding job are merged as they complete, only the windows of the
+    // other jobs are journaled
+    if(opts.resume && re_encode)
+        printf(" --- Resume is not supported with re-encoding, the job starts from the beginning\n");
+    else if(opts.resume) {
+        string key = inputFile + "|" + outputFilename + "|" + to_string(tot_frames) + "|" + to_string(framerate) +
+                     "|" + to_string(opts.dedup) + "|" + to_string(opts.targetSizeMB) + "|" + to_string(opts.cmaf) +
+                     "|" + to_string(opts.cmafGop);
+        for(auto &rendition : opts.renditions)
+            key += "|" + rendition.name() + ":" + rendition.bitrate;
+        jobJournal.open(tmpOutputDir + outputFilename + ".journal", key);
+    }
+
+    // co-located with other workloads: every thread and process of the job runs at idle
+    // priority, the encoder threads follow the cpu pressure
+    if(opts.background) {
+        int maxTokens = opts.cpuBudget > 0 ? opts.cpuBudget : thread::hardware_concurrency();
+        if(!cpuTokens.isEnabled())
+            cpuTokens.start(maxTokens);
+        // the governor keeps the normal priority to react while the machine is busy
+        if(!pressureGovernor.start(cpuTokens, maxTokens))
+            printf(" --- CPU pressure not available, encoder threads bounded to %d\n", maxTokens);
+        if(!lowerPriority())
+            printf(" --- SCHED_IDLE not available, running at nice 19\n");
+    }
+
+    string proxyPath = finalOutputPath + outputFilename.substr(0, outputFilename.rfind('.')) + "_proxy.ts";
+    if(opts.proxyHeight > 0)
+        proxySink.open(proxyPath);
+
+    // the windows are published in the manifests as they complete, there is nothing to merge
+    string streamPath = finalOutputPath + outputFilename.substr(0, outputFilename.rfind('.')) + "_cmaf";
+    if(opts.cmaf) {
+        streamManifest.open(streamPath, opts.renditions, framerate);
+        if(hasAudio)
+            printf(" --- The audio is not packaged in the CMAF output\n");
+    }
+
+    if(!opts.liveTarget.empty() && !liveStream.open(opts.liveTarget, opts.liveBufferMB))
+        printf(" --- Cannot stream to %s, live stream disabled\n", opts.liveTarget.c_str());
+
+    // a worker must not be killed when its encoder closes the ring early
+    if(opts.transport == "pipe")
+        signal(SIGPIPE, SIG_IGN);
 
     // Init Emitter
-    Reader read( inputPath, numWorker, tot_frames, emitter_time, firstWindow_time );
+    Reader read( inputPath, numWorker, tot_frames, emitter_time, firstWindow_time, inputFile, opts );
 
     ffTime(START_TIME);
 
@@ -301,75 +995,156 @@ int parallelConverter(const string& inputPath,const string& filename,const strin
                 numWorker,
                 FFthreads,
                 tmpOutputPathNames,
-                pid2part,
-                part2pid,
+                renditionPathNames,
+                completedParts,
                 re_encode,
                 tmpOutputDir,
                 finalOutputPath,
-                framerate
+                framerate,
+                opts
             )
         );
     }
 
     ff_Farm<long> farm(std::move(Workers),read);
     farm.remove_collector();
+    // windows of different cost, and split tail windows, go to whichever worker is free
+    if(opts.costWindows || opts.tailSplit)
+        farm.set_scheduling_ondemand();
+    // the threads are placed by the workers themselves
+    if(opts.placement)
+        farm.no_mapping();
+
+    // the audio track is extracted, trimmed and converted while the windows encode, then muxed
+    // by the concatenation of the video
+    string audioPath;
+    std::thread audioPrep;
+    long audioPrepMsec = 0;
+    long audioWaitMsec = 0;
+    if(hasAudio && !opts.cmaf) {
+        audioPath = tmpOutputDir + "audio_" + outputFilename.substr(0, outputFilename.rfind('.')) + ".m4a";
+        audioPrep = std::thread([&] {
+            auto start = std::chrono::high_resolution_clock::now();
+            int tokens = cpuTokens.acquire(1);
+            pid_t pid = audioConverter(inputAudio, audioPath, double(tot_frames) / framerate);
+            string failure = encodeFailure(pid > 0 ? waitChildProc(pid) : -1, {audioPath});
+            // a codec the MP4 cannot carry, e.g. the PCM of a .mov, is encoded instead
+            if(!failure.empty() && audioCopied(inputAudio)) {
+                printf(" --- Audio track not copied (%s), encoding it to AAC\n", failure.c_str());
+                pid = audioConverter(inputAudio, audioPath, double(tot_frames) / framerate, true);
+                failure = encodeFailure(pid > 0 ? waitChildProc(pid) : -1, {audioPath});
+            }
+            cpuTokens.release(tokens);
+            audioPrepMsec = std::chrono::duration_cast<std::chrono::milliseconds>(
+                    std::chrono::high_resolution_clock::now() - start).count();
+            if(!failure.empty())
+                encodeFailures.fail("audio preparation: " + failure);
+        });
+    }
+    auto joinAudio = [&] {
+        auto start = std::chrono::high_resolution_clock::now();
+        if(audioPrep.joinable())
+            audioPrep.join();
+        audioWaitMsec += std::chrono::duration_cast<std::chrono::milliseconds>(
+                std::chrono::high_resolution_clock::now() - start).count();
+    };
 
+    // IF re-encoding enabled, partial outputs are merged while the other windows encode
+    string tmpOutPutPath;
+    std::thread reducer;
+    if(re_encode) {
+        reducer = std::thread([&] {
+            tmpOutPutPath = waitChildProcsReduce(
+                                    completedParts,
+                                    numWorker,
+                                    to_string(FFthreads),
+                                    outputFilename,
+                                    tmpOutputDir,
+                                    finalOutputPath
+                                );
+        });
+    }
+
+    int farmResult = farm.run_and_wait_end();
+    completedParts.close();
+    if(reducer.joinable())
+        reducer.join();
 
-    if (farm.run_and_wait_end()<0) {
+    if (farmResult<0) {
+        pressureGovernor.stop();
+        liveStream.finish();
+        joinAudio();
         error("Running farm ");
         return -1;
     }
 
+    // the tmp directory is kept, the completed windows of a journaled job are resumed
+    auto jobFailed = [&] {
+        if(!encodeFailures.aborted())
+            return false;
+        pressureGovernor.stop();
+        liveStream.finish();
+        joinAudio();
+        cerr << " --- Job failed: " << encodeFailures.reason() << endl;
+        return true;
+    };
+    if(jobFailed())
+        return -1;
+
+    // distribute the size budget by measured complexity and encode the windows again
+    if(opts.targetSizeMB > 0) {
+        double totalBits = double(opts.targetSizeMB) * 8 * 1024 * 1024 * 0.98; // container overhead
+        std::error_code ec;
+        joinAudio();
+        if(hasAudio)
+            totalBits -= 8.0 * fs::file_size(audioPath, ec);
+        secondPass(rateAllocator.allocate(max(totalBits, 1.0), framerate), numWorker, FFthreads, framerate,
+                   tmpOutputDir, outputFilename, tmpOutputPathNames);
+        if(jobFailed())
+            return -1;
+    }
+
+    // the audio track is normally ready long before the last window
+    joinAudio();
+    if(jobFailed())
+        return -1;
+
     // start Collector
-    if(!re_encode) {
+    if(!re_encode && !opts.cmaf) {
 
-        // wait for all child processes to finish
-        waitChildProcs(numWorker);
+        // workers return once their encoders finished
         //printf("now init concat\n");
 
-        // Set tmp output path
-        string outputPath = tmpOutputDir + outputFilename;
+        // Concatenate and mux every rendition on its own, or the single output
+        vector<pair<string, stringVec *>> outputs;
+        if(opts.renditions.empty())
+            outputs.emplace_back(outputFilename, &tmpOutputPathNames);
+        for(size_t r = 0; r < opts.renditions.size(); r++)
+            outputs.emplace_back(renditionFilename(outputFilename, opts.renditions[r]), &renditionPathNames[r]);
 
-        // If no audio set as final output path
-        if(!hasAudio) {
-             outputPath = finalOutputPath + outputFilename;
-        }
+        for(auto &output : outputs) {
+            if(encodeFailures.aborted())
+                break;
 
-        // Concatenate videos
-        mergeVideos(
-                outputFilename,
-                tmpOutputPathNames,
-                outputPath
-        );
+            string outputPath = finalOutputPath + output.first;
 
-        if(hasAudio) {
-            // Mux audio file
-            addAudio(
-                    inputAudio,
+            // Concatenate videos, with the audio track
+            mergeVideos(
+                    output.first,
+                    *output.second,
                     outputPath,
-                    finalOutputPath,
-                    outputFilename,
-                    numWorker
+                    audioPath
             );
         }
     }
 
     // IF re-encoding enabled
     if(re_encode) {
-        string tmpOutPutPath = waitChildProcsReduce(
-                                    pid2part,
-                                    part2pid,
-                                    numWorker,
-                                    to_string(FFthreads),
-                                    outputFilename,
-                                    tmpOutputDir,
-                                    finalOutputPath
-                                );
        // cout << "Reduce output: " << tmpOutPutPath << endl;
 
             // Mux audio file
             addAudio(
-                    inputAudio,
+                    hasAudio ? audioPath : inputAudio,
                     tmpOutPutPath,
                     finalOutputPath,
                     outputFilename,
@@ -377,15 +1152,50 @@ int parallelConverter(const string& inputPath,const string& filename,const strin
             );
     }
 
+    if(jobFailed())
+        return -1;
+
+    streamManifest.finish();
+    liveStream.finish();
+
     ffTime(STOP_TIME);
+    pressureGovernor.stop();
     printf(" --- Converter completed!\n");
     cout << " ****** First window: " << (tot_frames/numWorker)  <<" frames waiting time (ms): " << firstWindow_time << "\n";
     cout << " ****** Total waiting time for " << tot_frames << " frames(ms): " << emitter_time << "\n";
     cout << " ****** Time spent by " << numWorker << " WORKERS (ms): " << (ffTime(GET_TIME) - emitter_time) << "\n";
     cout << " ****** Program COMPLETION TIME (ms): " << (ffTime(GET_TIME)) << "\n";
+    if(!audioPath.empty())
+        cout << " ****** Audio preparation time (ms): " << audioPrepMsec << ", waited for it after the video (ms): " << audioWaitMsec << "\n";
+    transportStats.print();
+    dedupStats.print();
+    segmentCache.print();
+    segmentStore.print();
+    jobJournal.print();
+    encodeFailures.print();
+    frameLocality.print();
+    liveStream.print();
+    stragglerMonitor.print();
+    tailBalancer.print();
+    cpuTokens.print();
+    pressureGovernor.print();
+    memoryAdmission.print();
+    if(!opts.placementReport.empty())
+        placementReport(opts.placementReport, opts.placement, numWorker, FFthreads, tot_frames, ffTime(GET_TIME));
+    if(opts.costWindows)
+        costModel.print();
+    if(opts.targetSizeMB > 0) {
+        std::error_code ec;
+        uintmax_t outputSize = fs::file_size(finalOutputPath + outputFilename, ec);
+        cout << " ****** Target size (MB): " << opts.targetSizeMB << ", output size (MB): "
+             << (ec ? 0.0 : outputSize / 1048576.0) << "\n";
+    }
+    if(proxySink.isOpen())
+        cout << " ****** Proxy: " << proxyPath << " (" << proxySink.waiting() << " windows out of order)\n";
 
     // Clear tmp dir
     deleteDir(tmpOutputDir);
+    segmentStore.finish();
 
 
     return 0;
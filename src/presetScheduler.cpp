@@ -0,0 +1,117 @@
+/**
+ *  @file    presetScheduler.cpp
+ *  @author  Biniam Abrha Nigusse
+ *  @date    19/10/2026
+ *
+ *  @brief choice of the x264 preset of every window so that the job meets its deadline
+ *
+ */
+
+#include <mutex>
+#include <chrono>
+
+
+// x264 presets from the fastest to the slowest, with their encode time relative to medium
+const vector<pair<string, double>> X264_PRESETS = {
+        {"ultrafast", 0.12},
+        {"superfast", 0.18},
+        {"veryfast",  0.30},
+        {"faster",    0.55},
+        {"fast",      0.75},
+        {"medium",    1.00},
+        {"slow",      1.60},
+        {"slower",    2.60},
+        {"veryslow",  5.00}
+};
+
+/**
+ *  @name presetFactor
+ *  @brief encode time of a preset relative to medium
+ *  @return double value
+ *
+ */
+double presetFactor(const string &preset) {
+    for(auto &p : X264_PRESETS)
+        if(p.first == preset)
+            return p.second;
+    return 1.0;
+}
+
+/**
+ *  @name PresetScheduler
+ *  @brief tracks the encode speed of the completed windows, normalized to the medium preset,
+ *  and picks for every new window the slowest preset that keeps the projected completion
+ *  of the remaining frames within the deadline
+ *
+*/
+class PresetScheduler {
+private:
+    std::mutex mtx;
+    std::chrono::steady_clock::time_point deadline;
+    bool enabled = false;
+    int totFrames = 0;
+    int framesDone = 0;
+    int encoders = 1;
+    // encode time of one frame with the medium preset, moving average
+    double mediumMsPerFrame = 0.0;
+
+public:
+
+    /**
+     *  @name start
+     *  @brief set the deadline, seconds from now
+     *
+     */
+    void start(int deadlineSec, int tot_frames, int parallelEncoders) {
+        std::lock_guard<std::mutex> lock(mtx);
+        deadline = std::chrono::steady_clock::now() + std::chrono::seconds(deadlineSec);
+        totFrames = tot_frames;
+        encoders = max(1, parallelEncoders);
+        enabled = deadlineSec > 0;
+    }
+
+    bool isEnabled() const { return enabled; }
+
+    /**
+     *  @name choose
+     *  @brief preset of the next window, fallback is used until a window has completed
+     *  @return string preset name
+     *
+     */
+    string choose(const string &fallback) {
+        std::lock_guard<std::mutex> lock(mtx);
+        if(!enabled || mediumMsPerFrame <= 0.0)
+            return fallback;
+
+        double leftMs = std::chrono::duration_cast<std::chrono::milliseconds>(
+                deadline - std::chrono::steady_clock::now()).count();
+        double remainingFrames = max(totFrames - framesDone, 0);
+        // keep a margin for the merge and the mux
+        double budgetMs = leftMs * 0.9;
+
+        string chosen = X264_PRESETS.front().first;
+        for(auto &p : X264_PRESETS) {
+            double projectedMs = remainingFrames * mediumMsPerFrame * p.second / encoders;
+            if(projectedMs <= budgetMs)
+                chosen = p.first;
+        }
+        return chosen;
+    }
+
+    /**
+     *  @name complete
+     *  @brief feed back the encode time of a window encoded with preset
+     *
+     */
+    void complete(int frames, long encodeMs, const string &preset) {
+        std::lock_guard<std::mutex> lock(mtx);
+        framesDone += frames;
+        if(!enabled || frames <= 0 || encodeMs <= 0)
+            return;
+
+        double observed = double(encodeMs) / frames / presetFactor(preset);
+        mediumMsPerFrame = mediumMsPerFrame <= 0.0 ? observed : 0.7 * mediumMsPerFrame + 0.3 * observed;
+    }
+};
+
+PresetScheduler presetScheduler;
@@ -0,0 +1,78 @@
+/**
+ *  @file    rateAllocator.cpp
+ *  @author  Biniam Abrha Nigusse
+ *  @date    19/10/2026
+ *
+ *  @brief distribution of a job-wide bitrate budget across the windows, proportional to
+ *  the complexity measured by a fast analysis pass
+ *
+ */
+
+#include <map>
+#include <mutex>
+#include <cmath>
+
+
+/**
+ *  @name WindowAnalysis
+ *  @brief result of the analysis pass of a window and its allocated bitrate
+ *
+ */
+struct WindowAnalysis {
+    int firstFrame;
+    int frames;               // frames of the timeline covered by the window
+    int encodedFrames;        // frames given to the encoder (less with --dedup)
+    string frameSource;
+    string passLog;
+    uintmax_t analysisBytes;
+    long bitrate = 0;         // bits per second
+};
+
+/**
+ *  @name RateAllocator
+ *  @brief collects the analysis of every window, then splits the budget. The share of a
+ *  window grows with complexity^(1 - qcomp), as x264 does between frames (qcomp = 0.6).
+ *
+*/
+class RateAllocator {
+private:
+    std::mutex mtx;
+    std::map<int, WindowAnalysis> windows;
+
+public:
+    void add(const WindowAnalysis &w) {
+        std::lock_guard<std::mutex> lock(mtx);
+        windows[w.firstFrame] = w;
+    }
+
+    /**
+     *  @name allocate
+     *  @brief split totalBits between the analysed windows
+     *  @return vector of windows in frame order with their bitrate
+     *
+     */
+    vector<WindowAnalysis> allocate(double totalBits, int framerate) {
+        std::lock_guard<std::mutex> lock(mtx);
+        const double qcomp = 0.6;
+        vector<WindowAnalysis> result;
+        double totalWeight = 0.0;
+
+        for(auto &w : windows) {
+            double perFrame = double(max<uintmax_t>(w.second.analysisBytes, 1)) / max(w.second.frames, 1);
+            totalWeight += w.second.frames * pow(perFrame, 1.0 - qcomp);
+        }
+
+        for(auto &w : windows) {
+            WindowAnalysis a = w.second;
+            double perFrame = double(max<uintmax_t>(a.analysisBytes, 1)) / max(a.frames, 1);
+            double bits = totalBits * a.frames * pow(perFrame, 1.0 - qcomp) / totalWeight;
+            double seconds = double(a.frames) / framerate;
+            a.bitrate = max(1000L, long(bits / seconds));
+            result.push_back(a);
+        }
+
+        return result;
+    }
+};
+
+RateAllocator rateAllocator;
@@ -0,0 +1,68 @@
+/**
+ *  @file    sceneDetect.cpp
+ *  @author  Biniam Abrha Nigusse
+ *  @date    19/10/2026
+ *
+ *  @brief lightweight scene change analysis on downscaled luma thumbnails of the frames
+ *
+ */
+
+#include <cstdio>
+#include <cmath>
+
+#define THUMB_WIDTH   64
+#define THUMB_HEIGHT  36
+#define LUMA_BINS     32
+
+
+/**
+ *  @name lumaThumbnail
+ *  @brief decode a frame with ffmpeg into a THUMB_WIDTH x THUMB_HEIGHT gray image
+ *  @return vector of luma samples, empty if the frame could not be decoded
+ *
+ */
+vector<unsigned char> lumaThumbnail(const string &path) {
+    size_t size = THUMB_WIDTH * THUMB_HEIGHT;
+    string pixels = captureOutput({"ffmpeg", "-loglevel", "error", "-nostdin", "-threads", "1", "-i", path,
+                                   "-frames:v", "1", "-vf", "scale=" + to_string(THUMB_WIDTH) + ":" + to_string(THUMB_HEIGHT) +
+                                   ",format=gray", "-f", "rawvideo", "-"}, size);
+    if(pixels.size() != size)
+        return {};
+    return vector<unsigned char>(pixels.begin(), pixels.end());
+}
+
+/**
+ *  @name lumaHistogram
+ *  @brief normalized luma histogram of the thumbnail of a frame
+ *  @return vector of LUMA_BINS values summing to 1, empty if the frame could not be decoded
+ *
+ */
+vector<float> lumaHistogram(const string &path) {
+    vector<unsigned char> pixels = lumaThumbnail(path);
+    if(pixels.empty())
+        return {};
+
+    vector<float> hist(LUMA_BINS, 0.0f);
+    for(unsigned char p : pixels)
+        hist[p * LUMA_BINS / 256] += 1.0f;
+    for(float &h : hist)
+        h /= pixels.size();
+
+    return hist;
+}
+
+/**
+ *  @name sceneScore
+ *  @brief distance between the histograms of two consecutive frames
+ *  @return value between 0 (same content) and 1 (disjoint luma distribution)
+ *
+ */
+double sceneScore(const vector<float> &a, const vector<float> &b) {
+    if(a.size() != LUMA_BINS || b.size() != LUMA_BINS)
+        return 0.0;
+
+    double d = 0.0;
+    for(int i = 0; i < LUMA_BINS; i++)
+        d += fabs(a[i] - b[i]);
+    return d / 2.0;
+}
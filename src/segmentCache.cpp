@@ -0,0 +1,173 @@
+/**
+ *  @file    segmentCache.cpp
+ *  @author  Biniam Abrha Nigusse
+ *  @date    19/10/2026
+ *
+ *  @brief on-disk cache of encoded window segments addressed by the content of the
+ *  window frames and the encoding parameters, with size bounded LRU eviction
+ *
+ */
+
+#include <atomic>
+#include <mutex>
+#include <iomanip>
+
+
+/**
+ *  @name windowHash
+ *  @brief hash of the content of all the frames of a window, in order
+ *  @return 64 bit hash value
+ *
+ */
+uint64_t windowHash(const string &pattern, const vector<int> &frames) {
+    uint64_t h = frames.size();
+    for(int fno : frames)
+        h = hashFile(frameFilename(pattern, fno), h);
+    return h;
+}
+
+/**
+ *  @name SegmentCache
+ *  @brief a directory of segments named after their key. Entries are refreshed on every
+ *  hit and the least recently used are evicted once the directory exceeds its budget.
+ *
+*/
+class SegmentCache {
+private:
+    std::mutex mtx;
+    fs::path dir;
+    uintmax_t maxBytes = 0;
+
+    std::atomic<unsigned long> lookups{0};
+    std::atomic<unsigned long> hits{0};
+    std::atomic<unsigned long> hitFrames{0};
+    std::atomic<unsigned long> missFrames{0};
+    std::atomic<unsigned long> missEncodeMs{0};
+
+public:
+
+    /**
+     *  @name open
+     *  @brief enable the cache in dirName, bounded to maxMB megabytes
+     *
+     */
+    void open(const string &dirName, uintmax_t maxMB) {
+        dir = dirName;
+        maxBytes = maxMB << 20;
+        std::error_code ec;
+        fs::create_directories(dir, ec);
+        if(ec) {
+            cerr << "Segment cache disabled: " << ec.message() << endl;
+            dir.clear();
+        }
+    }
+
+    bool enabled() const { return !dir.empty(); }
+
+    /**
+     *  @name key
+     *  @brief cache key of a window: content hash of its frames combined with the encoding parameters
+     *  @return string hexadecimal key
+     *
+     */
+    string key(uint64_t framesHash, const string &params) const {
+        uint64_t h = hashBytes((const unsigned char *) params.data(), params.size(), framesHash);
+        std::ostringstream out;
+        out << std::hex << std::setw(16) << std::setfill('0') << h;
+        return out.str();
+    }
+
+    /**
+     *  @name fetch
+     *  @brief place the cached segments of key at the given output paths, all or none
+     *  @return boolean value, true on a hit
+     *
+     */
+    bool fetch(const string &key, const stringVec &outputs, int frames) {
+        std::lock_guard<std::mutex> lock(mtx);
+        lookups++;
+
+        for(size_t n = 0; n < outputs.size(); n++)
+            if(!fs::exists(entry(key, n)))
+                return false;
+
+        for(size_t n = 0; n < outputs.size(); n++) {
+            std::error_code ec;
+            fs::remove(outputs[n], ec);
+            if(!place(entry(key, n), outputs[n]))
+                return false;
+            // refresh the entry, eviction follows the modification time
+            fs::last_write_time(entry(key, n), fs::file_time_type::clock::now(), ec);
+        }
+
+        hits++;
+        hitFrames += frames;
+        return true;
+    }
+
+    /**
+     *  @name store
+     *  @brief add the segments produced by an encoder to the cache and evict old entries
+     *
+     */
+    void store(const string &key, const stringVec &outputs, int frames, long encodeMs) {
+        missFrames += frames;
+        missEncodeMs += encodeMs;
+
+        std::lock_guard<std::mutex> lock(mtx);
+        for(size_t n = 0; n < outputs.size(); n++) {
+            fs::path tmp = entry(key, n).string() + ".part";
+            std::error_code ec;
+            fs::remove(tmp, ec);
+            if(!place(outputs[n], tmp))
+                return;
+            fs::rename(tmp, entry(key, n), ec);
+        }
+        evict();
+    }
+
+    void print() const {
+        if(lookups == 0) return;
+        cout << " ****** Segment cache hit ratio: " << hits << "/" << lookups
+             << " (" << (hits * 100 / lookups) << "%)\n";
+        if(missFrames > 0)
+            cout << " ****** Encode time saved by the cache (ms, estimated): "
+                 << (hitFrames * missEncodeMs / missFrames) << "\n";
+    }
+
+private:
+    fs::path entry(const string &key, size_t n) const {
+        return dir / (key + "_" + to_string(n) + ".seg");
+    }
+
+    // hard link when possible, copy across filesystems
+    static bool place(const fs::path &from, const fs::path &to) {
+        std::error_code ec;
+        fs::create_hard_link(from, to, ec);
+        if(ec)
+            fs::copy_file(from, to, fs::copy_options::overwrite_existing, ec);
+        return !ec;
+    }
+
+    void evict() {
+        vector<pair<fs::file_time_type, fs::path>> entries;
+        uintmax_t total = 0;
+        std::error_code ec;
+
+        for(auto &f : fs::directory_iterator(dir, ec)) {
+            if(f.path().extension() != ".seg") continue;
+            total += f.file_size(ec);
+            entries.emplace_back(f.last_write_time(ec), f.path());
+        }
+
+        sort(entries.begin(), entries.end());
+        for(auto &e : entries) {
+            if(total <= maxBytes) break;
+            uintmax_t size = fs::file_size(e.second, ec);
+            if(fs::remove(e.second, ec))
+                total -= size;
+        }
+    }
+};
+
+SegmentCache segmentCache;
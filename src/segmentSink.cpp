@@ -0,0 +1,90 @@
+/**
+ *  @file    segmentSink.cpp
+ *  @author  Biniam Abrha Nigusse
+ *  @date    19/10/2026
+ *
+ *  @brief append encoded segments to a growing output in window order, as soon as
+ *  all the earlier windows are available
+ *
+ */
+
+#include <map>
+#include <mutex>
+#include <fstream>
+
+
+/**
+ *  @name OrderedSegmentSink
+ *  @brief collects segments completed in any order and appends them to the output
+ *  following the frame order. Segments must be byte-concatenable (e.g. MPEG-TS).
+ *
+*/
+class OrderedSegmentSink {
+private:
+    std::mutex mtx;
+    // first frame index of a completed segment -> (frames, path)
+    std::map<int, std::pair<int, std::string>> pending;
+    int nextIndex = 0;
+    std::string outputPath;
+    bool enabled = false;
+
+public:
+
+    /**
+     *  @name open
+     *  @brief truncate the output and expect the first segment to start at firstIndex
+     *
+     */
+    void open(const std::string &path, int firstIndex = 0) {
+        std::lock_guard<std::mutex> lock(mtx);
+        outputPath = path;
+        nextIndex = firstIndex;
+        enabled = true;
+        std::ofstream(outputPath, std::ios::binary | std::ios::trunc);
+    }
+
+    bool isOpen() const { return enabled; }
+
+    /**
+     *  @name add
+     *  @brief add a completed segment and flush every segment that is now in order
+     *  @return integer number of segments appended to the output
+     *
+     */
+    int add(int firstIndex, int frames, const std::string &segmentPath) {
+        std::lock_guard<std::mutex> lock(mtx);
+        pending[firstIndex] = std::make_pair(frames, segmentPath);
+
+        int appended = 0;
+        auto it = pending.find(nextIndex);
+        while(it != pending.end()) {
+            append(it->second.second);
+            nextIndex += it->second.first;
+            pending.erase(it);
+            appended++;
+            it = pending.find(nextIndex);
+        }
+        return appended;
+    }
+
+    /**
+     *  @name waiting
+     *  @brief number of segments held back by a missing earlier window
+     *  @return integer
+     *
+     */
+    int waiting() {
+        std::lock_guard<std::mutex> lock(mtx);
+        return pending.size();
+    }
+
+private:
+    void append(const std::string &segmentPath) {
+        std::ifstream in(segmentPath, std::ios::binary);
+        std::ofstream out(outputPath, std::ios::binary | std::ios::app);
+        out << in.rdbuf();
+        out.flush();
+        in.close();
+        remove(segmentPath.c_str());
+    }
+};
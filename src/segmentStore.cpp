@@ -0,0 +1,211 @@
+/**
+ *  @file    segmentStore.cpp
+ *  @author  Biniam Abrha Nigusse
+ *  @date    19/10/2026
+ *
+ *  @brief storage of the encoded segments until the merge: in memory (tmpfs) while they fit
+ *  a budget, on the disk of the tmp directory beyond it, and written as unlinked files that
+ *  get their name once their encoder exited
+ *
+ */
+
+#include <mutex>
+#include <fcntl.h>
+#include <unistd.h>
+
+// estimate of a frame before any segment of the job completed
+#define SEGMENT_FRAME_GUESS (200 * 1024)
+
+
+/**
+ *  @name StagedOutputs
+ *  @brief outputs of an encoder open as unlinked files, paths holds the names to give to ffmpeg
+ *
+ */
+struct StagedOutputs {
+    vector<int> fds;
+    stringVec paths;
+};
+
+/**
+ *  @name containerFormat
+ *  @brief ffmpeg format of an output from its extension, a staged output has none
+ *  @return string format, empty if unknown
+ *
+ */
+string containerFormat(const string &path) {
+    string ext = fs::path(path).extension().string();
+    if(ext == ".mp4" || ext == ".m4v")
+        return "mp4";
+    if(ext == ".mov")
+        return "mov";
+    if(ext == ".ts")
+        return "mpegts";
+    return "";
+}
+
+/**
+ *  @name stageOutputs
+ *  @brief open an unlinked file (O_TMPFILE) in the directory of every output, reached by the
+ *  encoder through /proc; the outputs themselves are used where O_TMPFILE is not supported
+ *  @return StagedOutputs, without descriptors if not staged
+ *
+ */
+StagedOutputs stageOutputs(const stringVec &outputs) {
+    StagedOutputs staged;
+    for(auto &output : outputs) {
+        string dir = fs::path(output).parent_path().string();
+        int fd = open(dir.empty() ? "." : dir.c_str(), O_TMPFILE | O_WRONLY | O_CLOEXEC, 0644);
+        if(fd < 0) {
+            for(int opened : staged.fds)
+                close(opened);
+            return {{}, outputs};
+        }
+        staged.fds.push_back(fd);
+        staged.paths.push_back("/proc/" + to_string(getpid()) + "/fd/" + to_string(fd));
+    }
+    return staged;
+}
+
+/**
+ *  @name linkOutputs
+ *  @brief give the staged files their names, replacing any previous output, or drop them
+ *  @return boolean value, false if a file could not be linked
+ *
+ */
+bool linkOutputs(StagedOutputs &staged, const stringVec &outputs, bool keep) {
+    bool linked = true;
+    for(size_t n = 0; n < staged.fds.size(); n++) {
+        if(keep) {
+            remove(outputs[n].c_str());
+            if(linkat(AT_FDCWD, staged.paths[n].c_str(), AT_FDCWD, outputs[n].c_str(), AT_SYMLINK_FOLLOW) != 0) {
+                perror("linkat");
+                linked = false;
+            }
+        }
+        close(staged.fds[n]);
+    }
+    staged.fds.clear();
+    return linked;
+}
+
+/**
+ *  @name SegmentPlacement
+ *  @brief directory of the segments of a window, with the memory reserved for them
+ *
+ */
+struct SegmentPlacement {
+    string dir;
+    uintmax_t reserved = 0;
+};
+
+/**
+ *  @name SegmentStore
+ *  @brief the segments of a window go to memory when their estimated size still fits the
+ *  budget, with what the running windows reserved; the estimate follows the bytes per frame
+ *  of the completed windows. The merge then reads them from memory.
+ *
+*/
+class SegmentStore {
+private:
+    std::mutex mtx;
+    string ramDir;
+    uintmax_t budget = 0;
+    uintmax_t used = 0;
+    uintmax_t observedBytes = 0;
+    long observedFrames = 0;
+    int ramSegments = 0;
+    int diskSegments = 0;
+    uintmax_t ramBytes = 0;
+    uintmax_t diskBytes = 0;
+    int staged = 0;
+    int unstaged = 0;
+
+public:
+
+    /**
+     *  @name start
+     *  @brief keep up to budgetMB of segments in dir, a directory on a tmpfs
+     *  @return boolean value, false if the directory cannot be created
+     *
+     */
+    bool start(const string &dir, long budgetMB) {
+        std::error_code ec;
+        fs::create_directories(dir, ec);
+        if(ec)
+            return false;
+        ramDir = sanitize_path(dir.c_str());
+        budget = uintmax_t(budgetMB) << 20;
+        return true;
+    }
+
+    bool isEnabled() const { return !ramDir.empty(); }
+
+    /**
+     *  @name place
+     *  @brief directory of the segments of a window of frames, diskDir once memory is full
+     *  @return SegmentPlacement
+     *
+     */
+    SegmentPlacement place(const string &diskDir, int frames, size_t outputs) {
+        std::lock_guard<std::mutex> lock(mtx);
+        if(ramDir.empty())
+            return {diskDir, 0};
+        uintmax_t perFrame = observedFrames > 0 ? observedBytes / observedFrames : SEGMENT_FRAME_GUESS;
+        uintmax_t estimate = perFrame * frames * outputs;
+        if(used + estimate > budget)
+            return {diskDir, 0};
+        used += estimate;
+        return {ramDir, estimate};
+    }
+
+    /**
+     *  @name settle
+     *  @brief the segments of a window are complete, or failed: the size they take replaces
+     *  the reservation
+     *
+     */
+    void settle(const SegmentPlacement &placement, int frames, const stringVec &outputs) {
+        uintmax_t bytes = 0;
+        for(auto &output : outputs) {
+            std::error_code ec;
+            uintmax_t size = fs::file_size(output, ec);
+            bytes += ec ? 0 : size;
+        }
+
+        std::lock_guard<std::mutex> lock(mtx);
+        bool ram = !ramDir.empty() && placement.dir == ramDir;
+        if(ram)
+            used = used - placement.reserved + bytes;
+        if(bytes == 0)
+            return;
+        observedBytes += bytes / outputs.size();
+        observedFrames += frames;
+        (ram ? ramSegments : diskSegments) += outputs.size();
+        (ram ? ramBytes : diskBytes) += bytes;
+    }
+
+    // an encoder wrote its outputs as unlinked files, or could not
+    void stage(bool unlinked) {
+        std::lock_guard<std::mutex> lock(mtx);
+        (unlinked ? staged : unstaged)++;
+    }
+
+    // the segments in memory are not needed anymore
+    void finish() {
+        if(ramDir.empty()) return;
+        std::error_code ec;
+        fs::remove_all(ramDir, ec);
+    }
+
+    void print() {
+        std::lock_guard<std::mutex> lock(mtx);
+        if(!ramDir.empty())
+            cout << " ****** Segments in memory: " << ramSegments << " (MB): " << ramBytes / 1048576.0
+                 << ", on disk: " << diskSegments << " (MB): " << diskBytes / 1048576.0 << "\n";
+        if(unstaged > 0)
+            cout << " ****** Encoders without unlinked outputs (no O_TMPFILE): " << unstaged << " of " << staged + unstaged << "\n";
+    }
+};
+
+SegmentStore segmentStore;
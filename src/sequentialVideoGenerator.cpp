@@ -9,11 +9,10 @@
 
 int seqImgToVideoConverter( const string& input_path, const string& filename, const string& outputFilename,
         const string& output_format, int ffmpeg_thds, int tot_frames, bool skip_save, bool re_encode,
-         int framerate, bool hasAudio, const string& inputAudio) {
+         int framerate, bool hasAudio, const string& inputAudio, const string& tmpOutputDir = "./tmp/",
+         const string& finalOutputPath = "./output/") {
 
     string inputFile = input_path + filename;
-    const string tmpOutputDir = "./tmp/";
-    const string finalOutputPath = "./output/";
     //string inputAudio = "audio_720.oga";
     string input_params = " -loglevel error -stats -framerate " + to_string(framerate) + " -start_number 0 ";
     string tmpOutputVideo = "tmp" + outputFilename;
@@ -30,8 +29,8 @@ int seqImgToVideoConverter( const string& input_path, const string& filename, co
         tmpOutputPath = tmpOutputDir + tmpOutputVideo;
     }
     // create output directory if it doesn't exist.
-    mkdir(finalOutputPath.c_str(), S_IRWXU | S_IRWXG | S_IROTH | S_IXOTH);
-    mkdir(tmpOutputDir.c_str(), S_IRWXU | S_IRWXG | S_IROTH | S_IXOTH);
+    fs::create_directories(finalOutputPath);
+    fs::create_directories(tmpOutputDir);
 
     auto start   = std::chrono::high_resolution_clock::now();
     // Loading input file paths in a stringVec
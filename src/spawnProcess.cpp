@@ -10,144 +10,461 @@
 #include <sys/types.h>
 #include <cstdio>
 #include <wait.h>
+#include <set>
+#include <deque>
+#include <mutex>
+#include <condition_variable>
+
+#include <sys/resource.h>
+
+#include "cpuTokens.cpp"
+#include "memoryAdmission.cpp"
+#include "encodeFailures.cpp"
 
 /**
- *  @name imageConverter
- *  @brief Function to spawn a process which generates video from images sequences
- *  later on to be concatenated
- *  @return integer number on success
+ *  @name spawnFFmpeg
+ *  @brief Function to fork a child process executing ffmpeg with the given arguments.
+ *  If inputFd is a valid descriptor it becomes the standard input of the child.
+ *  @return pid of the child process
  *
  */
-int imageConverter( const string& input_filename, const string& output_filename, const string& output_format,
-        int num_worker, int tot_frames, bool skip_save, const string& input_params, const string& framerate,
-        int chunkSize, const string &threads ) {
+pid_t spawnFFmpeg( const stringVec &args, int inputFd = -1 ) {
 
-    // TODO: cross-platform command
-    string chunk = to_string(chunkSize);
-   // char* argv[MAX_ARGS];
-    pid_t child_pid;
-   // int child_status;
+    // build argv before forking, the child must not allocate
+    vector<char *> argv;
+    for(auto &arg : args) argv.push_back(const_cast<char *>(arg.c_str()));
+    argv.push_back(nullptr);
 
-   // parsecmd(cmd,argv);
-    child_pid = fork();
+    pid_t child_pid = fork();
     if(child_pid == 0) {
         /* This is done by the child process. */
-
-        //execve(path, args, newenviron)
-        char *newargv[21];
-        for(int i=0; i < 20; i++) newargv[i] = (char *)malloc(sizeof(char) * 60); //allocate the array in memory
-        strcpy(newargv[0], "ffmpeg");
-        strcpy(newargv[1], "-framerate");
-        strcpy(newargv[2], framerate.c_str());
-        strcpy(newargv[3], "-start_number");
-        strcpy(newargv[4], input_params.c_str());
-        strcpy(newargv[5], "-i");
-        strcpy(newargv[6], input_filename.c_str());
-        strcpy(newargv[7], "-threads");
-        strcpy(newargv[8], threads.c_str());// pass as param
-        strcpy(newargv[9], "-frames:v");
-        strcpy(newargv[10], chunk.c_str()); // pass as param
-        strcpy(newargv[11], "-vcodec");
-        strcpy(newargv[12], "libx264");
-        strcpy(newargv[13], "-preset");
-        strcpy(newargv[14], "medium");
-        strcpy(newargv[15],  output_filename.c_str());
-        strcpy(newargv[16], "-loglevel");
-        strcpy(newargv[17], "error");
-        strcpy(newargv[18], "-stats");
-        strcpy(newargv[19], "-nostdin");
-        newargv[20]= (char *)nullptr;
+        if(inputFd >= 0)
+            dup2(inputFd, STDIN_FILENO);
 
         // execute command
-        execvp("ffmpeg", newargv);
+        execvp("ffmpeg", argv.data());
 
         /* If execvp returns, it must have failed. */
         printf("Unknown command\n");
-        exit(0);
+        _exit(127);
     }
 
-    return 0;
+    return child_pid;
 }
 
-
 /**
- *  @name imageConverterReduce
- *  @brief Function to spawn a process which generates video from images sequences and
- *  pass data for reduce workers
- *  @return integer number on success
+ *  @name captureOutput
+ *  @brief run a program (args[0], looked up in the PATH) without a shell, and read up to
+ *  maxBytes of its standard output; its standard error is discarded
+ *  @return string output, empty if the program could not be run
  *
  */
-int imageConverterReduce( const string& input_filename, const string& output_filename, const string& output_format,
-                    int num_worker, int tot_frames, bool skip_save, const string& input_params, const string& framerate,
-                    int chunkSize, const string &threads,  map<pid_t, int> &pid2part, map<int, pid_t> &part2pid, int index ) {
+string captureOutput( const stringVec &args, size_t maxBytes ) {
 
-    // TODO: cross-platform command
-    string chunk = to_string(chunkSize);
-    // char* argv[MAX_ARGS];
-    pid_t child_pid;
-    // int child_status;
+    vector<char *> argv;
+    for(auto &arg : args) argv.push_back(const_cast<char *>(arg.c_str()));
+    argv.push_back(nullptr);
+
+    int fds[2];
+    if(args.empty() || pipe2(fds, O_CLOEXEC) < 0)
+        return "";
+    int devNull = open("/dev/null", O_WRONLY | O_CLOEXEC);
 
-    // parsecmd(cmd,argv);
-    child_pid = fork();
+    pid_t child_pid = fork();
     if(child_pid == 0) {
-        /* This is done by the child process. */
+        dup2(fds[1], STDOUT_FILENO);
+        if(devNull >= 0)
+            dup2(devNull, STDERR_FILENO);
+        execvp(argv[0], argv.data());
+        _exit(127);
+    }
+    close(fds[1]);
+    if(devNull >= 0)
+        close(devNull);
+
+    string output;
+    char buffer[4096];
+    while(child_pid > 0 && output.size() < maxBytes) {
+        ssize_t n = read(fds[0], buffer, min(sizeof(buffer), maxBytes - output.size()));
+        if(n < 0 && errno == EINTR)
+            continue;
+        if(n <= 0)
+            break;
+        output.append(buffer, n);
+    }
+    close(fds[0]);
 
-        //execve(path, args, newenviron)
-        char *newargv[21];
-        for(int i=0; i < 20; i++) newargv[i] = (char *)malloc(sizeof(char) * 60); //allocate the array in memory
-
-        strcpy(newargv[0], "ffmpeg");
-        strcpy(newargv[1], "-framerate");
-        strcpy(newargv[2], framerate.c_str());
-        strcpy(newargv[3], "-start_number");
-        strcpy(newargv[4], input_params.c_str());
-        strcpy(newargv[5], "-i");
-        strcpy(newargv[6], input_filename.c_str());
-        strcpy(newargv[7], "-threads");
-        strcpy(newargv[8], threads.c_str());// pass as param
-        strcpy(newargv[9], "-frames:v");
-        strcpy(newargv[10], chunk.c_str()); // pass as param
-        strcpy(newargv[11], "-vcodec");
-        strcpy(newargv[12], "libx264");
-        strcpy(newargv[13], "-preset");
-        strcpy(newargv[14], "veryslow");
-        strcpy(newargv[15],  output_filename.c_str());
-        strcpy(newargv[16], "-loglevel");
-        strcpy(newargv[17], "error");
-        strcpy(newargv[18], "-stats");
-        strcpy(newargv[19], "-nostdin");
-        newargv[20]= (char *)nullptr;
+    int status;
+    while(child_pid > 0 && waitpid(child_pid, &status, 0) < 0 && errno == EINTR);
+    return output;
+}
 
-        // execute command
-        execvp("ffmpeg", newargv);
+/**
+ *  @name imageInputArgs
+ *  @brief Build the ffmpeg input arguments of a chunk of an image sequence. With a valid
+ *  inputFd the frames are read from stdin (image2pipe) instead of the image pattern.
+ *  An .ffconcat input is a list of frames with their own durations (variable frame rate).
+ *  @return stringVec of arguments
+ *
+ */
+stringVec imageInputArgs( const string& input_filename, const string& input_params, const string& framerate, int inputFd ) {
 
-        /* If execvp returns, it must have failed. */
-        printf("Unknown command\n");
-        exit(0);
-    } else {
-            pid2part[child_pid] = index;
-            part2pid[index] = child_pid;
+    stringVec args = {"ffmpeg"};
+
+    const string concatExt = ".ffconcat";
+    bool isConcatList = input_filename.size() > concatExt.size() &&
+            input_filename.compare(input_filename.size() - concatExt.size(), concatExt.size(), concatExt) == 0;
+
+    if(inputFd >= 0)
+        args.insert(args.end(), {"-f", "image2pipe", "-framerate", framerate, "-i", "-"});
+    else if(isConcatList)
+        args.insert(args.end(), {"-f", "concat", "-safe", "0", "-i", input_filename, "-vsync", "vfr"});
+    else
+        args.insert(args.end(), {"-framerate", framerate, "-start_number", input_params, "-i", input_filename});
+
+    return args;
+}
+
+/**
+ *  @name imageEncoderArgs
+ *  @brief Build the ffmpeg arguments encoding a chunk of an image sequence, outputOptions are
+ *  given before the output (container and GOP of fragmented outputs)
+ *  @return stringVec of arguments
+ *
+ */
+stringVec imageEncoderArgs( const string& input_filename, const string& output_filename, const string& input_params,
+        const string& framerate, int chunkSize, const string &threads, const string &preset, int inputFd,
+        const stringVec &outputOptions = {} ) {
+
+    stringVec args = imageInputArgs(input_filename, input_params, framerate, inputFd);
+
+    args.insert(args.end(), {
+            "-threads", threads,
+            "-frames:v", to_string(chunkSize),
+            "-vcodec", "libx264",
+            "-preset", preset
+    });
+    args.insert(args.end(), outputOptions.begin(), outputOptions.end());
+    args.insert(args.end(), {
+            output_filename,
+            "-loglevel", "error",
+            "-stats",
+            "-nostdin"
+    });
+
+    return args;
+}
+
+/**
+ *  @name renditionEncoderArgs
+ *  @brief Build the ffmpeg arguments encoding a chunk of an image sequence into one output per
+ *  rendition. The frames are decoded once and fanned out to the encoders by a split/scale graph.
+ *  @return stringVec of arguments
+ *
+ */
+stringVec renditionEncoderArgs( const string& input_filename, const stringVec &output_filenames, const string& input_params,
+        const string& framerate, int chunkSize, const string &threads, const string &preset, int inputFd,
+        const vector<Rendition> &renditions, const stringVec &outputOptions = {} ) {
+
+    stringVec args = imageInputArgs(input_filename, input_params, framerate, inputFd);
+
+    string graph = "[0:v]split=" + to_string(renditions.size());
+    for(size_t i = 0; i < renditions.size(); i++)
+        graph += "[s" + to_string(i) + "]";
+    for(size_t i = 0; i < renditions.size(); i++)
+        graph += ";[s" + to_string(i) + "]scale=-2:" + to_string(renditions[i].height) + "[v" + to_string(i) + "]";
+    args.insert(args.end(), {"-filter_complex", graph});
+
+    for(size_t i = 0; i < renditions.size(); i++) {
+        args.insert(args.end(), {
+                "-map", "[v" + to_string(i) + "]",
+                "-threads", threads,
+                "-frames:v", to_string(chunkSize),
+                "-vcodec", "libx264",
+                "-preset", preset
+        });
+        if(!renditions[i].bitrate.empty())
+            args.insert(args.end(), {"-b:v", renditions[i].bitrate});
+        args.insert(args.end(), outputOptions.begin(), outputOptions.end());
+        args.push_back(output_filenames[i]);
     }
 
+    args.insert(args.end(), {"-loglevel", "error", "-stats", "-nostdin"});
 
-    return 0;
+    return args;
 }
 
 /**
- *  @name waitChildProcs
- *  @brief Function to wait termination of child process for concatenation of results
- *  @return integer number on success
+ *  @name renditionConverter
+ *  @brief Function to spawn a single process which generates one video per rendition from the
+ *  same images sequence, later on to be concatenated per rendition
+ *  @return pid of the encoder process
+ *
+ */
+int renditionConverter( const string& input_filename, const stringVec &output_filenames, const string& input_params,
+        const string& framerate, int chunkSize, const string &threads, const vector<Rendition> &renditions,
+        int inputFd = -1, const string &preset = "medium", const stringVec &outputOptions = {} ) {
+
+    return spawnFFmpeg(
+            renditionEncoderArgs(input_filename, output_filenames, input_params, framerate, chunkSize, threads,
+                                 preset, inputFd, renditions, outputOptions),
+            inputFd
+    );
+}
+
+/**
+ *  @name proxyConverter
+ *  @brief Function to spawn a process which generates a low resolution MPEG-TS preview of a chunk.
+ *  Timestamps are shifted by the chunk position so that the segments can be appended to each other.
+ *  @return pid of the encoder process
+ *
+ */
+int proxyConverter( const string& input_filename, const string& output_filename, const string& input_params,
+        const string& framerate, int chunkSize, const string &threads, int height, int fpsCap, int inputFd = -1 ) {
+
+    stringVec args = imageInputArgs(input_filename, input_params, framerate, inputFd);
+
+    // trim before the frame rate cap, the number of output frames is not the chunk size anymore
+    string filters = "trim=end_frame=" + to_string(chunkSize) + ",scale=-2:" + to_string(height);
+    if(fpsCap > 0)
+        filters += ",fps=" + to_string(fpsCap);
+
+    double offset = atof(input_params.c_str()) / atof(framerate.c_str());
+
+    args.insert(args.end(), {
+            "-vf", filters,
+            "-threads", threads,
+            "-vcodec", "libx264",
+            "-preset", "ultrafast",
+            "-output_ts_offset", to_string(offset),
+            "-f", "mpegts",
+            output_filename,
+            "-loglevel", "error",
+            "-nostdin"
+    });
+
+    return spawnFFmpeg(args, inputFd);
+}
+
+/**
+ *  @name streamConverter
+ *  @brief Function to spawn a process which remuxes the video of an encoded chunk to MPEG-TS.
+ *  Timestamps are shifted by offset seconds so that the chunks play as a single stream.
+ *  @return pid of the remux process
+ *
+ */
+int streamConverter( const string& input_filename, const string& output_filename, double offset ) {
+
+    return spawnFFmpeg({
+            "ffmpeg",
+            "-i", input_filename,
+            "-map", "0:v",
+            "-c", "copy",
+            "-output_ts_offset", to_string(offset),
+            "-f", "mpegts",
+            "-y", output_filename,
+            "-loglevel", "error",
+            "-nostdin"
+    });
+}
+
+/**
+ *  @name audioConverter
+ *  @brief Function to spawn a process which extracts the audio track to mux with the video,
+ *  trimmed to its duration, into an MP4 container. The tracks of the files an MP4 usually
+ *  carries are copied unless encode is set, the others are encoded to AAC.
+ *  @return pid of the audio process, the copy may still fail on a codec the MP4 cannot carry
+ *
+ */
+bool audioCopied( const string& input_filename ) {
+    static const stringVec copyExtensions = {".aac", ".m4a", ".mp3", ".mp4", ".mov"};
+    string ext = fs::path(input_filename).extension().string();
+    transform(ext.begin(), ext.end(), ext.begin(), ::tolower);
+    return find(copyExtensions.begin(), copyExtensions.end(), ext) != copyExtensions.end();
+}
+
+int audioConverter( const string& input_filename, const string& output_filename, double seconds, bool encode = false ) {
+
+    bool copy = !encode && audioCopied(input_filename);
+
+    stringVec args = {"ffmpeg", "-i", input_filename, "-map", "0:a:0", "-vn", "-t", to_string(seconds)};
+    if(copy)
+        args.insert(args.end(), {"-c:a", "copy"});
+    else
+        args.insert(args.end(), {"-c:a", "aac", "-b:a", "192k"});
+    args.insert(args.end(), {"-f", "mp4", "-y", output_filename, "-loglevel", "error", "-nostdin"});
+
+    return spawnFFmpeg(args);
+}
+
+/**
+ *  @name twoPassConverter
+ *  @brief Function to spawn one pass of a two-pass encode of a chunk. The first pass runs at
+ *  constant quality and writes the x264 statistics, the second pass hits the given bitrate.
+ *  @return pid of the encoder process
+ *
+ */
+int twoPassConverter( const string& input_filename, const string& output_filename, const string& input_params,
+        const string& framerate, int chunkSize, const string &threads, int pass, const string &passLog,
+        long bitrate, int inputFd = -1 ) {
+
+    stringVec args = imageInputArgs(input_filename, input_params, framerate, inputFd);
+
+    args.insert(args.end(), {
+            "-threads", threads,
+            "-frames:v", to_string(chunkSize),
+            "-vcodec", "libx264",
+            "-preset", "medium"
+    });
+    if(pass == 1)
+        args.insert(args.end(), {"-crf", "23"});
+    else
+        args.insert(args.end(), {"-b:v", to_string(bitrate), "-maxrate", to_string(bitrate * 3 / 2),
+                                 "-bufsize", to_string(bitrate * 2)});
+    args.insert(args.end(), {
+            "-pass", to_string(pass),
+            "-passlogfile", passLog,
+            "-y", output_filename,
+            "-loglevel", "error",
+            "-stats",
+            "-nostdin"
+    });
+
+    return spawnFFmpeg(args, inputFd);
+}
+
+/**
+ *  @name imageConverter
+ *  @brief Function to spawn a process which generates video from images sequences
+ *  later on to be concatenated
+ *  @return pid of the encoder process
+ *
+ */
+int imageConverter( const string& input_filename, const string& output_filename, const string& output_format,
+        int num_worker, int tot_frames, bool skip_save, const string& input_params, const string& framerate,
+        int chunkSize, const string &threads, int inputFd = -1, const string &preset = "medium",
+        const stringVec &outputOptions = {} ) {
+
+    // TODO: cross-platform command
+    return spawnFFmpeg(
+            imageEncoderArgs(input_filename, output_filename, input_params, framerate, chunkSize, threads, preset, inputFd,
+                             outputOptions),
+            inputFd
+    );
+}
+
+/**
+ *  @name remoteConverter
+ *  @brief Function to spawn a process which has a chunk of images sequence encoded by an encoder
+ *  node and writes the segment it returns. The frames are read by the node from shared storage,
+ *  or sent with the request if shipFrames is set. The process is the converter itself, in
+ *  --remote_encode mode, its exit status is the one of the remote encoder.
+ *  @return pid of the process
  *
  */
-int  waitChildProcs(int nw){
-    for ( int i = 0; i < nw; i++ ) {
-        int child_status;
-        pid_t pid = wait(&child_status);
-        cout << "parent: finished child with pid " << pid << endl;
+int remoteConverter( const string &endpoint, const string& input_filename, const string& output_filename,
+        const string& input_params, const string& framerate, int chunkSize, const string &threads,
+        const string &preset, bool shipFrames ) {
+
+    stringVec args = {"converter", "--remote_encode", endpoint, input_filename, output_filename, input_params,
+                      framerate, to_string(chunkSize), threads, preset, shipFrames ? "ship" : "shared"};
+    vector<char *> argv;
+    for(auto &arg : args) argv.push_back(const_cast<char *>(arg.c_str()));
+    argv.push_back(nullptr);
+
+    pid_t child_pid = fork();
+    if(child_pid == 0) {
+        execv("/proc/self/exe", argv.data());
+        _exit(127);
     }
-    return 0;
+
+    return child_pid;
 }
 
+
+/**
+ *  @name imageConverterReduce
+ *  @brief Function to spawn a process which generates video from images sequences and
+ *  pass data for reduce workers
+ *  @return pid of the encoder process
+ *
+ */
+int imageConverterReduce( const string& input_filename, const string& output_filename, const string& output_format,
+                    int num_worker, int tot_frames, bool skip_save, const string& input_params, const string& framerate,
+                    int chunkSize, const string &threads, int inputFd = -1, const string &preset = "veryslow" ) {
+
+    // TODO: cross-platform command
+    return spawnFFmpeg(
+            imageEncoderArgs(input_filename, output_filename, input_params, framerate, chunkSize, threads, preset, inputFd),
+            inputFd
+    );
+}
+
+/**
+ *  @name waitChildProc
+ *  @brief Function to wait termination of a given child process, its resource usage
+ *  is stored in usage if given
+ *  @return exit status of the child, -1 if it did not exit normally
+ *
+ */
+int  waitChildProc(pid_t pid, struct rusage *usage = nullptr){
+    int child_status;
+    while(wait4(pid, &child_status, 0, usage) < 0) {
+        if(errno != EINTR)
+            return -1;
+    }
+    cout << "parent: finished child with pid " << pid << endl;
+    return WIFEXITED(child_status) ? WEXITSTATUS(child_status) : -1;
+}
+
+/**
+ *  @name PartQueue
+ *  @brief Queue of the partial outputs completed by the workers, consumed by the reduce
+ *
+*/
+class PartQueue {
+    public:
+        void push(int part) {
+            std::lock_guard<std::mutex> lock(mtx);
+            parts.push_back(part);
+            cv.notify_one();
+        }
+
+        // no more parts will be pushed
+        void close() {
+            std::lock_guard<std::mutex> lock(mtx);
+            closed = true;
+            cv.notify_one();
+        }
+
+        /**
+        *  @name pop
+        *  @brief wait up to timeout for a completed part
+        *  @return boolean value, false if none is available
+        *
+        */
+        bool pop(int &part, std::chrono::milliseconds timeout) {
+            std::unique_lock<std::mutex> lock(mtx);
+            cv.wait_for(lock, timeout, [this] { return !parts.empty() || closed; });
+            if(parts.empty())
+                return false;
+            part = parts.front();
+            parts.pop_front();
+            return true;
+        }
+
+        bool drained() {
+            std::lock_guard<std::mutex> lock(mtx);
+            return closed && parts.empty();
+        }
+
+    private:
+        std::mutex mtx;
+        std::condition_variable cv;
+        std::deque<int> parts;
+        bool closed = false;
+};
+
 /**
  *  @name Reduce
  *  @brief Class to determine index values of reduce workers
@@ -201,88 +518,128 @@ class Reduce {
 
 /**
  *  @name waitChildProcsReduce
- *  @brief Class to determine the index of reduce workers
+ *  @brief Function pairing the partial outputs as soon as they complete and merging them
+ *  with a reduce tree. Runs while the workers are still encoding.
  *  @return string filename of the final reduce output
  *
 */
-string  waitChildProcsReduce( map<pid_t, int> &pid2part, map<int, pid_t> &part2pid, int numWorker,
+string  waitChildProcsReduce( PartQueue &completedParts, int numWorker,
         string FFthreads, const string &outputFilename, const string &tmpOutputDir, const string &finalOutputPath){
     // reduce
+    struct Merge {
+        int part;
+        int threads;
+        MemoryTicket memory;
+        int first, second;
+    };
+    map<pid_t, Merge> pid2part;            // running merges
+    deque<pair<int, int>> ready;           // pairs of parts waiting for cpu tokens
+    map<int, int> attempts;                // failed merges per resulting part
+    set<int> completed;
     pid_t pid;
     int status;
     int i,j,k;
 
-    string tmpOutput, tmpInput_i, tmpInput_j, output;
+    string output;
+    auto partName = [&](int part) {
+        return tmpOutputDir + "tmp_" + to_string(part) + "_" + outputFilename + ".mov";
+    };
 
     // init reduce
     Reduce reduce(numWorker);
 
-    while (pid2part.size() > 0) {
+    while (true) {
 
-         pid = waitpid((pid_t) -1, &status, 0);
-        // Verify status if exited with success
-        assert(pid2part.find(pid) != pid2part.end());
-        i = pid2part[pid];
-        cout << " +++ Reduce Worker " << i << " STARTED" <<endl;
-        if(numWorker <= 1){
-            output = tmpOutputDir + "tmp_" + to_string(i) + "_" + outputFilename + ".mov";
-           return output;
+        // a failed window aborted the job, the running merges are left to complete
+        if (encodeFailures.aborted()) {
+            for (auto &merge : pid2part) {
+                waitpid(merge.first, nullptr, 0);
+                cpuTokens.release(merge.second.threads);
+                memoryAdmission.release(merge.second.memory, 0);
+            }
+            return "";
         }
-        //rename(tmp.<i>.mp4, <i>.mp4);
-        part2pid[i] = (pid_t) -1;		// marked as complete
-        j = reduce.companion(i);
-        if (j < 0) break;	// was last concatenation
-        if (part2pid[j] == (pid_t) -1) { // also companion is completed
-            pid2part.erase(pid);
-            pid2part.erase(part2pid[j]);
-            part2pid.erase(i);
-            part2pid.erase(j);
-            if (i > j)
-                std::swap(i, j);
+
+        // a merge starts once the pool has tokens left, the running ones are reaped meanwhile
+        while (!ready.empty()) {
+            int threads = cpuTokens.tryAcquire(stoi(FFthreads));
+            if (threads == 0)
+                break;
+            MemoryTicket memory;
+            if (!memoryAdmission.tryAdmit("medium", threads, memory)) {
+                cpuTokens.release(threads);
+                break;
+            }
+            tie(i, j) = ready.front();
+            ready.pop_front();
             k = reduce.resulting(j);
-            pid = fork();
-            if (pid == 0) {
 
-                char *args[17];
-                tmpInput_i = tmpOutputDir + "tmp_" + to_string(i) + "_" + outputFilename + ".mov";
-                tmpInput_j = tmpOutputDir + "tmp_" + to_string(j) + "_" + outputFilename + ".mov";
-                tmpOutput = tmpOutputDir + "tmp_" + to_string(k) + "_" + outputFilename + ".mov";
+            pid = spawnFFmpeg({
+                    "ffmpeg",
+                    "-i", partName(i),  // set input1
+                    "-i", partName(j),  // set input2
+                    "-filter_complex", " [0:v] [1:v] concat=n=2:v=1 ",
+                    "-c:v", "libx264",
+                    "-threads", to_string(threads),
+                    partName(k),
+                    "-loglevel", "error",
+                    "-stats",
+                    "-nostdin"
+            });
+
+            pid2part[pid] = {k, threads, memory, i, j};
+            output = partName(k);
+        }
 
-                for(int i=0; i < 16; i++) {
-                    args[i] = (char *)malloc(sizeof(char) * 60); //allocate the array in memory
+        // next completed part: an encoded window or a finished merge
+        if (!completedParts.pop(i, std::chrono::milliseconds(20))) {
+            auto done = pid2part.end();
+            struct rusage usage;
+            for (auto it = pid2part.begin(); it != pid2part.end(); ++it) {
+                if (wait4(it->first, &status, WNOHANG, &usage) == it->first) {
+                    done = it;
+                    break;
                 }
-
-                strcpy(args[0], "ffmpeg");
-                strcpy(args[1], "-i");
-                strcpy(args[2], tmpInput_i.c_str()); // set input1
-                strcpy(args[3], "-i");
-                strcpy(args[4], tmpInput_j.c_str());  // set input2
-                strcpy(args[5], "-filter_complex");
-                strcpy(args[6], " [0:v] [1:v] concat=n=2:v=1 ");
-                strcpy(args[7], "-c:v");
-                strcpy(args[8], "libx264");
-                strcpy(args[9], "-threads");
-                strcpy(args[10], FFthreads.c_str()); // TODO get threads
-                strcpy(args[11], tmpOutput.c_str());
-                strcpy(args[12], "-loglevel");
-                strcpy(args[13], "error");
-                strcpy(args[14], "-stats");
-                strcpy(args[15], "-nostdin");
-                args[16]= (char *)nullptr;
-
-                // execute command
-                execvp("ffmpeg", args);
-
-                /* If execvp returns, it must have failed. */
-                printf("Unknown command\n");
-                exit(0);
-
-            } else {
-                pid2part[pid] = k;
-                part2pid[k] = pid;
-                output = tmpOutputDir + "tmp_" + to_string(k) + "_" + outputFilename + ".mov";
             }
+            if (done == pid2part.end()) {
+                if (completedParts.drained() && pid2part.empty() && ready.empty())
+                    break;  // some parts never arrived
+                continue;
+            }
+            Merge merge = done->second;
+            cpuTokens.release(merge.threads);
+            memoryAdmission.release(merge.memory, usage.ru_maxrss);
+            pid2part.erase(done);
+
+            // a failed merge is run again from its parts, ahead of the other pairs
+            string failure = encodeFailure(WIFEXITED(status) ? WEXITSTATUS(status) : -1, {partName(merge.part)});
+            if (!failure.empty()) {
+                if (attempts[merge.part]++ < encodeFailures.maxRetries()) {
+                    printf(" --- Merge of parts %d and %d failed (%s), retrying\n", merge.first, merge.second, failure.c_str());
+                    encodeFailures.retry();
+                    remove(partName(merge.part).c_str());
+                    ready.emplace_front(merge.first, merge.second);
+                    continue;
+                }
+                encodeFailures.fail("merge of parts " + to_string(merge.first) + " and " + to_string(merge.second) + ": " + failure);
+                continue;
+            }
+            i = merge.part;
+        }
 
+        cout << " +++ Reduce Worker " << i << " STARTED" <<endl;
+        if(numWorker <= 1){
+           return partName(i);
+        }
+        completed.insert(i);		// marked as complete
+        j = reduce.companion(i);
+        if (j < 0) break;	// was last concatenation
+        if (completed.count(j) > 0) { // also companion is completed
+            completed.erase(i);
+            completed.erase(j);
+            if (i > j)
+                std::swap(i, j);
+            ready.emplace_back(i, j);
         }
 
     }
@@ -293,20 +650,24 @@ string  waitChildProcsReduce( map<pid_t, int> &pid2part, map<int, pid_t> &part2p
 
 /**
  *  @name mergeVideos
- *  @brief a function to spawn a process to concatenate the partial output of workers
+ *  @brief a function to spawn a process to concatenate the partial output of workers, the
+ *  prepared audio track, if any, is muxed in the same pass
  *  @return integer number on success
  *
 */
-int mergeVideos( const string &filename, stringVec &tmpInputPaths, string &tmpOutputPath ) {
+int mergeVideos( const string &filename, stringVec &tmpInputPaths, string &tmpOutputPath, const string &audioPath = "" ) {
     auto start = std::chrono::high_resolution_clock::now();
-    if(tmpInputPaths.size() == 1) {
+    if(tmpInputPaths.size() == 1 && audioPath.empty()) {
         tmpOutputPath = tmpInputPaths[0];
         return 0;
     }
     string tmpFile = filename + ".txt";
     ofstream file (tmpFile);
    // string tmpOutputPath = outputDir + filename;
-    sort(tmpInputPaths.begin(), tmpInputPaths.end());
+    // the parts may be in memory or on disk, their names give the frame order
+    sort(tmpInputPaths.begin(), tmpInputPaths.end(), [](const string &a, const string &b) {
+        return fs::path(a).filename() < fs::path(b).filename();
+    });
 
     if( file.is_open() ) {
 
@@ -317,17 +678,40 @@ int mergeVideos( const string &filename, stringVec &tmpInputPaths, string &tmpOu
         file.close();
     }
 
-    printf(" --- concatinating parts ...\n");
+    printf(audioPath.empty() ? " --- concatinating parts ...\n" : " --- concatinating parts with the audio track ...\n");
 
-    string cmd = "ffmpeg -loglevel error -f concat -safe 0 -i " + filename +  ".txt -c copy "+ tmpOutputPath;
+    string cmd = "ffmpeg -loglevel error -f concat -safe 0 -i " + filename +  ".txt ";
+    if(!audioPath.empty())
+        cmd += "-i " + audioPath + " -map 0:v:0 -map 1:a:0 -shortest ";
+    cmd += "-c copy " + tmpOutputPath;
     //cout<< cmd << endl;
+    int tokens = cpuTokens.acquire(1);
     int ret = system( cmd.c_str() );
+    cpuTokens.release(tokens);
 
     remove(tmpFile.c_str());
     auto elapsed = std::chrono::high_resolution_clock::now() - start;
     auto elapsed_msec    = std::chrono::duration_cast<std::chrono::milliseconds>(elapsed).count();
     cout << " ****** MERGE TIME (ms): " << elapsed_msec << "\n";
 
+    uintmax_t bytesRead = 0;
+    stringVec inputs = tmpInputPaths;
+    if(!audioPath.empty())
+        inputs.push_back(audioPath);
+    for(auto &path : inputs) {
+        std::error_code ec;
+        uintmax_t size = fs::file_size(path, ec);
+        bytesRead += ec ? 0 : size;
+    }
+    std::error_code ec;
+    uintmax_t bytesWritten = fs::file_size(tmpOutputPath, ec);
+    cout << " ****** MERGE I/O (MB): read " << bytesRead / 1048576.0 << ", written " << (ec ? 0 : bytesWritten) / 1048576.0 << "\n";
+
+    string failure = encodeFailure(WIFEXITED(ret) ? WEXITSTATUS(ret) : -1, {tmpOutputPath});
+    if(!failure.empty()) {
+        encodeFailures.fail("concatenation of " + filename + ": " + failure);
+        return -1;
+    }
     return 0;
 }
 
@@ -342,14 +726,21 @@ int  addAudio( const string &inputAudioPath, const string &inputVideoPath,
     auto start = std::chrono::high_resolution_clock::now();
     printf(" --- Adding audio file ...\n");
 
+    int threads = cpuTokens.acquire(par_degree);
     string cmd = "ffmpeg -loglevel error -i " + inputVideoPath + " -i " + inputAudioPath +
-            " -shortest -c copy -map 0:v:0 -map 1:a:0 " + " -threads " + to_string(par_degree) + " " +
+            " -shortest -c copy -map 0:v:0 -map 1:a:0 " + " -threads " + to_string(max(1, threads)) + " " +
             outputVideoPath + outputFilename;
 
     int ret = system( cmd.c_str() );
+    cpuTokens.release(threads);
     auto elapsed = std::chrono::high_resolution_clock::now() - start;
     auto elapsed_msec    = std::chrono::duration_cast<std::chrono::milliseconds>(elapsed).count();
     cout << " ****** Audio Time (ms): " << elapsed_msec << "\n";
 
+    string failure = encodeFailure(WIFEXITED(ret) ? WEXITSTATUS(ret) : -1, {outputVideoPath + outputFilename});
+    if(!failure.empty()) {
+        encodeFailures.fail("audio mux of " + outputFilename + ": " + failure);
+        return -1;
+    }
     return 0;
 }
@@ -0,0 +1,142 @@
+/**
+ *  @file    straggler.cpp
+ *  @author  Biniam Abrha Nigusse
+ *  @date    19/10/2026
+ *
+ *  @brief progress tracking of the running encoders and detection of the stragglers,
+ *  windows projected to finish far behind the others that are worth encoding twice
+ *
+ */
+
+#include <atomic>
+#include <mutex>
+#include <algorithm>
+
+#define STRAGGLER_POLL_MS       250
+#define STRAGGLER_MIN_MS        3000   // no projection before the encoder ran for a while
+#define STRAGGLER_MIN_PROGRESS  0.05
+
+
+/**
+ *  @name sourceBytes
+ *  @brief size of the frame files read by the encoder of a window
+ *  @return size in bytes
+ *
+ */
+uintmax_t sourceBytes(const string &pattern, const vector<int> &frames) {
+    uintmax_t total = 0;
+    for(int fno : frames) {
+        std::error_code ec;
+        uintmax_t size = fs::file_size(frameFilename(pattern, fno), ec);
+        if(!ec)
+            total += size;
+    }
+    return total;
+}
+
+/**
+ *  @name encoderProgress
+ *  @brief fraction of its input already read by an encoder, from the rchar counter of
+ *  /proc/<pid>/io. Frames and pipe reads are both counted, the x264 lookahead keeps the
+ *  reads a few frames ahead of the encode.
+ *  @return value between 0 and 1, -1 if unknown
+ *
+ */
+double encoderProgress(pid_t pid, uintmax_t inputBytes) {
+    if(inputBytes == 0)
+        return -1.0;
+
+    ifstream io("/proc/" + to_string(pid) + "/io");
+    string field;
+    uintmax_t value;
+    while(io >> field >> value) {
+        if(field == "rchar:")
+            return min(1.0, double(value) / inputBytes);
+    }
+    return -1.0;
+}
+
+/**
+ *  @name StragglerMonitor
+ *  @brief shared view of the encoders: how many workers are busy and how long a frame takes
+ *  on the windows already completed. An encoder is a straggler once its projected duration is
+ *  factor times the median of its peers and a fresh duplicate would still finish first.
+ *
+*/
+class StragglerMonitor {
+private:
+    std::mutex mtx;
+    double factor = 0.0;
+    int workers = 1;
+    int active = 0;
+    vector<double> msPerFrame;
+
+    std::atomic<unsigned long> duplicates{0};
+    std::atomic<unsigned long> duplicatesWon{0};
+
+public:
+
+    /**
+     *  @name start
+     *  @brief enable the detection, factor 0 disables it
+     *
+     */
+    void start(double slowFactor, int numWorkers) {
+        std::lock_guard<std::mutex> lock(mtx);
+        factor = slowFactor;
+        workers = max(1, numWorkers);
+    }
+
+    bool isEnabled() const { return factor > 0.0; }
+
+    void begin() {
+        std::lock_guard<std::mutex> lock(mtx);
+        active++;
+    }
+
+    /**
+     *  @name end
+     *  @brief an encode completed, its speed becomes a reference for the running ones
+     *
+     */
+    void end(int frames, long encodeMs) {
+        std::lock_guard<std::mutex> lock(mtx);
+        active--;
+        if(frames > 0 && encodeMs > 0)
+            msPerFrame.push_back(double(encodeMs) / frames);
+    }
+
+    /**
+     *  @name isStraggler
+     *  @brief decide whether a running encode deserves a speculative duplicate
+     *  @return boolean value
+     *
+     */
+    bool isStraggler(long elapsedMs, double progress, int frames) {
+        std::lock_guard<std::mutex> lock(mtx);
+        if(factor <= 0.0 || active >= workers || msPerFrame.empty())
+            return false;
+        if(elapsedMs < STRAGGLER_MIN_MS || progress < STRAGGLER_MIN_PROGRESS || progress >= 1.0)
+            return false;
+
+        vector<double> sorted = msPerFrame;
+        nth_element(sorted.begin(), sorted.begin() + sorted.size() / 2, sorted.end());
+        double expectedMs = sorted[sorted.size() / 2] * frames;
+        double projectedMs = elapsedMs / progress;
+
+        return projectedMs > factor * expectedMs && projectedMs - elapsedMs > expectedMs;
+    }
+
+    void speculated(bool duplicateWon) {
+        duplicates++;
+        if(duplicateWon)
+            duplicatesWon++;
+    }
+
+    void print() const {
+        if(duplicates == 0) return;
+        cout << " ****** Speculative duplicates: " << duplicates << ", finished first: " << duplicatesWon << "\n";
+    }
+};
+
+StragglerMonitor stragglerMonitor;
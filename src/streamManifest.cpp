@@ -0,0 +1,357 @@
+/**
+ *  @file    streamManifest.cpp
+ *  @author  Biniam Abrha Nigusse
+ *  @date    19/10/2026
+ *
+ *  @brief fragmented MP4 (CMAF) output: every window is a self-contained fMP4 file, an init
+ *  segment followed by one fragment per GOP, published in an HLS playlist and a DASH MPD as
+ *  soon as all the earlier windows are available
+ *
+ */
+
+#include <map>
+#include <mutex>
+#include <fstream>
+#include <iomanip>
+#include <functional>
+#include <ctime>
+
+#define CMAF_TIMESCALE 90000
+
+
+/**
+ *  @name initSegmentSize
+ *  @brief size of the init segment of a fragmented MP4, the boxes before the first moof
+ *  @return size in bytes, 0 if the file has no fragment
+ *
+ */
+uintmax_t initSegmentSize(const string &path) {
+    ifstream in(path, ios::binary);
+    uintmax_t offset = 0;
+    unsigned char header[16];
+    while(in.seekg(offset) && in.read((char *) header, 8)) {
+        uint64_t size = (uint64_t(header[0]) << 24) | (header[1] << 16) | (header[2] << 8) | header[3];
+        if(string((char *) header + 4, 4) == "moof")
+            return offset;
+        if(size == 1 && in.read((char *) header + 8, 8)) {
+            size = 0;
+            for(int n = 8; n < 16; n++)
+                size = (size << 8) | header[n];
+        }
+        if(size < 8)
+            return 0;
+        offset += size;
+    }
+    return 0;
+}
+
+/**
+ *  @name VideoSampleEntry
+ *  @brief codec and picture size of the video track of an init segment, for the players to
+ *  pick a rendition before loading it
+ *
+*/
+struct VideoSampleEntry {
+    string codecs;      // RFC 6381, avc1.PPCCLL from the SPS, empty if unknown
+    int width = 0;
+    int height = 0;
+};
+
+/**
+ *  @name videoSampleEntry
+ *  @brief read the first avc1/avc3 sample entry of the init segment of a fragmented MP4,
+ *  moov/trak/mdia/minf/stbl/stsd, and the profile, constraints and level of its avcC
+ *  @return VideoSampleEntry, empty codecs if the track is not H.264
+ *
+ */
+VideoSampleEntry videoSampleEntry(const string &path, uintmax_t initSize) {
+    VideoSampleEntry entry;
+    vector<unsigned char> init(initSize);
+    ifstream in(path, ios::binary);
+    if(initSize == 0 || !in.read((char *) init.data(), initSize))
+        return entry;
+
+    auto u32 = [&](size_t at) { return (uint32_t(init[at]) << 24) | (init[at + 1] << 16) | (init[at + 2] << 8) | init[at + 3]; };
+    auto u16 = [&](size_t at) { return (init[at] << 8) | init[at + 1]; };
+    static const vector<string> containers = {"moov", "trak", "mdia", "minf", "stbl"};
+
+    // the boxes of [begin, end), stsd holds its entries after a version and a count
+    std::function<void(size_t, size_t)> walk = [&](size_t begin, size_t end) {
+        for(size_t at = begin; at + 8 <= end && entry.codecs.empty();) {
+            size_t size = u32(at);
+            string type((char *) &init[at + 4], 4);
+            if(size < 8 || at + size > end)
+                return;
+            if(find(containers.begin(), containers.end(), type) != containers.end())
+                walk(at + 8, at + size);
+            else if(type == "stsd")
+                walk(at + 16, at + size);
+            else if((type == "avc1" || type == "avc3") && size >= 86) {
+                entry.width = u16(at + 32);
+                entry.height = u16(at + 34);
+                // the boxes of the sample entry follow its 78 bytes of fields
+                for(size_t box = at + 86; box + 12 <= at + size; box += max<size_t>(8, u32(box))) {
+                    if(string((char *) &init[box + 4], 4) != "avcC")
+                        continue;
+                    char codecs[16];
+                    snprintf(codecs, sizeof(codecs), "%s.%02x%02x%02x", type.c_str(), init[box + 9], init[box + 10], init[box + 11]);
+                    entry.codecs = codecs;
+                    break;
+                }
+            }
+            at += size;
+        }
+    };
+    walk(0, init.size());
+    return entry;
+}
+
+/**
+ *  @name cmafOutputArgs
+ *  @brief ffmpeg output options of a window: fragments starting on every keyframe, a fixed GOP
+ *  so that the keyframes of all the renditions are aligned, and the timestamps of the window
+ *  in the timeline of the job, kept by the tfdt of its fragments (frag_discont) rather than
+ *  moved to an edit list
+ *  @return stringVec of arguments
+ *
+ */
+stringVec cmafOutputArgs(int firstFrame, int framerate, int gopFrames) {
+    std::ostringstream offset;
+    offset << std::fixed << std::setprecision(6) << double(firstFrame) / framerate;
+    return {"-g", to_string(gopFrames), "-keyint_min", to_string(gopFrames), "-sc_threshold", "0",
+            "-output_ts_offset", offset.str(), "-video_track_timescale", to_string(CMAF_TIMESCALE),
+            "-movflags", "+frag_keyframe+empty_moov+default_base_moof+frag_discont", "-use_editlist", "0",
+            "-f", "mp4"};
+}
+
+/**
+ *  @name StreamManifest
+ *  @brief the windows completed in any order are published in frame order: an HLS media
+ *  playlist per output, with a master playlist for renditions, and a DASH MPD with a period
+ *  per window, since the init segment of every window is its own. Both are rewritten and
+ *  renamed over the previous ones, live until the job completes.
+ *
+*/
+class StreamManifest {
+private:
+    struct Fragment {
+        string file;
+        uintmax_t init;
+        uintmax_t size;
+        VideoSampleEntry video;
+    };
+    struct Window {
+        int first;
+        int frames;
+        vector<Fragment> outputs;   // one per rendition
+    };
+
+    std::mutex mtx;
+    string dir;
+    vector<string> names;
+    vector<int> heights;
+    int framerate = 25;
+    map<int, Window> pending;
+    vector<Window> published;
+    int nextIndex = 0;
+    time_t startTime = 0;
+    bool enabled = false;
+
+public:
+
+    /**
+     *  @name open
+     *  @brief publish the windows in dir, one output per rendition (a single one without)
+     *
+     */
+    void open(const string &directory, const vector<Rendition> &renditions, int fps) {
+        std::lock_guard<std::mutex> lock(mtx);
+        dir = directory;
+        framerate = max(1, fps);
+        for(auto &r : renditions) {
+            names.push_back(r.name());
+            heights.push_back(r.height);
+        }
+        if(names.empty()) {
+            names.push_back("video");
+            heights.push_back(0);
+        }
+        startTime = time(nullptr);
+        fs::create_directories(dir);
+        enabled = true;
+        write(false);
+    }
+
+    bool isOpen() const { return enabled; }
+
+    // segment of a window for an output
+    string segmentPath(int firstFrame, size_t output) const {
+        return dir + "/" + windowTag(firstFrame) + "_" + names[output] + ".mp4";
+    }
+
+    /**
+     *  @name add
+     *  @brief add a completed window and publish every window now in order
+     *  @return integer number of windows published
+     *
+     */
+    int add(int firstFrame, int frames, const stringVec &outputs) {
+        std::lock_guard<std::mutex> lock(mtx);
+        Window w{firstFrame, frames, {}};
+        for(auto &output : outputs) {
+            std::error_code ec;
+            uintmax_t size = fs::file_size(output, ec);
+            uintmax_t init = initSegmentSize(output);
+            w.outputs.push_back({fs::path(output).filename().string(), init, ec ? 0 : size, videoSampleEntry(output, init)});
+        }
+        pending[firstFrame] = w;
+
+        int added = 0;
+        auto it = pending.find(nextIndex);
+        while(it != pending.end()) {
+            published.push_back(it->second);
+            nextIndex += it->second.frames;
+            pending.erase(it);
+            added++;
+            it = pending.find(nextIndex);
+        }
+        if(added > 0)
+            write(false);
+        return added;
+    }
+
+    /**
+     *  @name finish
+     *  @brief close the playlists, the windows still out of order are published as they are
+     *
+     */
+    void finish() {
+        std::lock_guard<std::mutex> lock(mtx);
+        if(!enabled) return;
+        for(auto &w : pending)
+            published.push_back(w.second);
+        pending.clear();
+        write(true);
+        cout << " ****** CMAF output: " << dir << "/index.m3u8, " << dir << "/manifest.mpd (" << published.size() << " windows)\n";
+    }
+
+private:
+    double duration(const Window &w) const { return double(w.frames) / framerate; }
+
+    // peak bitrate of an output over the published windows
+    long bandwidth(size_t output) const {
+        double peak = 0;
+        for(auto &w : published)
+            peak = max(peak, (w.outputs[output].size - w.outputs[output].init) * 8 / duration(w));
+        return max(1L, long(peak));
+    }
+
+    static void replace(const string &path, const string &content) {
+        {
+            ofstream out(path + ".tmp", ios::trunc);
+            out << content;
+        }
+        rename((path + ".tmp").c_str(), path.c_str());
+    }
+
+    void write(bool complete) {
+        bool single = names.size() == 1 && heights[0] == 0;
+        for(size_t o = 0; o < names.size(); o++)
+            replace(dir + "/" + (single ? "index" : names[o]) + ".m3u8", mediaPlaylist(o, complete));
+        if(!single)
+            replace(dir + "/index.m3u8", masterPlaylist());
+        replace(dir + "/manifest.mpd", mpd(complete));
+    }
+
+    string mediaPlaylist(size_t o, bool complete) const {
+        double target = 1;
+        for(auto &w : published)
+            target = max(target, ceil(duration(w)));
+
+        std::ostringstream m;
+        m << "#EXTM3U\n#EXT-X-VERSION:7\n#EXT-X-TARGETDURATION:" << int(target) << "\n"
+          << "#EXT-X-PLAYLIST-TYPE:EVENT\n#EXT-X-INDEPENDENT-SEGMENTS\n#EXT-X-MEDIA-SEQUENCE:0\n";
+        m << std::fixed << std::setprecision(6);
+        for(auto &w : published) {
+            const Fragment &f = w.outputs[o];
+            m << "#EXT-X-MAP:URI=\"" << f.file << "\",BYTERANGE=\"" << f.init << "@0\"\n"
+              << "#EXT-X-BYTERANGE:" << (f.size - f.init) << "@" << f.init << "\n"
+              << "#EXTINF:" << duration(w) << ",\n" << f.file << "\n";
+        }
+        if(complete)
+            m << "#EXT-X-ENDLIST\n";
+        return m.str();
+    }
+
+    string masterPlaylist() const {
+        std::ostringstream m;
+        m << "#EXTM3U\n#EXT-X-VERSION:7\n#EXT-X-INDEPENDENT-SEGMENTS\n";
+        for(size_t o = 0; o < names.size(); o++) {
+            m << "#EXT-X-STREAM-INF:BANDWIDTH=" << bandwidth(o);
+            if(!published.empty()) {
+                const VideoSampleEntry &video = published.front().outputs[o].video;
+                if(!video.codecs.empty())
+                    m << ",CODECS=\"" << video.codecs << "\"";
+                if(video.width > 0 && video.height > 0)
+                    m << ",RESOLUTION=" << video.width << "x" << video.height;
+            }
+            m << "\n" << names[o] << ".m3u8\n";
+        }
+        return m.str();
+    }
+
+    static string isoDuration(double seconds) {
+        std::ostringstream d;
+        d << "PT" << std::fixed << std::setprecision(3) << seconds << "S";
+        return d.str();
+    }
+
+    static string isoTime(time_t t) {
+        char buf[32];
+        strftime(buf, sizeof(buf), "%Y-%m-%dT%H:%M:%SZ", gmtime(&t));
+        return buf;
+    }
+
+    string mpd(bool complete) const {
+        double total = 0;
+        for(auto &w : published)
+            total += duration(w);
+
+        std::ostringstream m;
+        m << "<?xml version=\"1.0\" encoding=\"utf-8\"?>\n"
+          << "<MPD xmlns=\"urn:mpeg:dash:schema:mpd:2011\" profiles=\"urn:mpeg:dash:profile:isoff-main:2011\" minBufferTime=\"PT2S\"";
+        if(complete)
+            m << " type=\"static\" mediaPresentationDuration=\"" << isoDuration(total) << "\">\n";
+        else
+            m << " type=\"dynamic\" availabilityStartTime=\"" << isoTime(startTime) << "\" publishTime=\""
+              << isoTime(time(nullptr)) << "\" minimumUpdatePeriod=\"PT2S\">\n";
+
+        for(auto &w : published) {
+            double start = double(w.first) / framerate;
+            m << "  <Period id=\"" << w.first << "\" start=\"" << isoDuration(start) << "\">\n"
+              << "    <AdaptationSet contentType=\"video\" mimeType=\"video/mp4\" segmentAlignment=\"true\" startWithSAP=\"1\">\n";
+            for(size_t o = 0; o < names.size(); o++) {
+                const Fragment &f = w.outputs[o];
+                m << "      <Representation id=\"" << names[o] << "\" bandwidth=\"" << bandwidth(o) << "\"";
+                if(!f.video.codecs.empty())
+                    m << " codecs=\"" << f.video.codecs << "\"";
+                if(f.video.width > 0 && f.video.height > 0)
+                    m << " width=\"" << f.video.width << "\" height=\"" << f.video.height << "\"";
+                else if(heights[o] > 0)
+                    m << " height=\"" << heights[o] << "\"";
+                m << ">\n"
+                  << "        <SegmentList timescale=\"" << CMAF_TIMESCALE << "\" duration=\"" << long(duration(w) * CMAF_TIMESCALE)
+                  << "\" presentationTimeOffset=\"" << long(start * CMAF_TIMESCALE) << "\">\n"
+                  << "          <Initialization sourceURL=\"" << f.file << "\" range=\"0-" << (f.init - 1) << "\"/>\n"
+                  << "          <SegmentURL media=\"" << f.file << "\" mediaRange=\"" << f.init << "-" << (f.size - 1) << "\"/>\n"
+                  << "        </SegmentList>\n"
+                  << "      </Representation>\n";
+            }
+            m << "    </AdaptationSet>\n  </Period>\n";
+        }
+        m << "</MPD>\n";
+        return m.str();
+    }
+};
+
+StreamManifest streamManifest;
@@ -0,0 +1,118 @@
+/**
+ *  @file    tailBalancer.cpp
+ *  @author  Biniam Abrha Nigusse
+ *  @date    19/10/2026
+ *
+ *  @brief use of the cores left idle at the end of a job: the last windows are split
+ *  between the idle workers and the last encoders get the threads of the idle ones
+ *
+ */
+
+#include <mutex>
+#include <thread>
+
+#define TAIL_MIN_FRAMES  8     // smallest sub-window worth its own encoder
+#define TAIL_MAX_THREADS 16    // FFmpeg does not scale further
+
+
+/**
+ *  @name TailBalancer
+ *  @brief counts the windows dispatched by the emitter and completed by the workers.
+ *  The tail of the job starts once the windows left to dispatch are fewer than the idle
+ *  workers: from then on those workers get no window, unless the ones sent are split.
+ *  Frames arrive in any order, the tail is decided by the frames not yet dispatched, not
+ *  by the position of a window.
+ *
+*/
+class TailBalancer {
+private:
+    std::mutex mtx;
+    bool enabled = false;
+    int workers = 1;
+    int cores = 1;
+    int dispatched = 0;
+    int completed = 0;
+    bool tail = false;
+    int splits = 0;
+
+public:
+
+    /**
+     *  @name start
+     *  @brief enable the balancing of the tail of a job run by numWorkers workers
+     *
+     */
+    void start(int numWorkers) {
+        std::lock_guard<std::mutex> lock(mtx);
+        enabled = true;
+        workers = max(1, numWorkers);
+        cores = max(1, int(thread::hardware_concurrency()));
+    }
+
+    bool isEnabled() const { return enabled; }
+
+    /**
+     *  @name split
+     *  @brief called by the emitter before sending a window, framesLeft frames of the job
+     *  are still to be dispatched after it in windows of windowFrames. In the tail the
+     *  window is cut in contiguous sub-windows for the idle workers no other window will
+     *  reach.
+     *  @return vector of the windows to send
+     *
+     */
+    vector<vector<int>> split(const vector<int> &frames, int framesLeft, int windowFrames) {
+        std::lock_guard<std::mutex> lock(mtx);
+        if(!enabled)
+            return {frames};
+
+        // the workers left idle once this window and the ones still to come have started
+        int idle = max(0, workers - (dispatched - completed));
+        int windowsLeft = (max(0, framesLeft) + max(1, windowFrames) - 1) / max(1, windowFrames);
+        int spare = idle - 1 - windowsLeft;
+        int pieces = 1;
+        if(spare > 0) {
+            tail = true;
+            pieces = max(1, min(1 + spare, int(frames.size()) / TAIL_MIN_FRAMES));
+        }
+
+        vector<vector<int>> windows;
+        size_t first = 0;
+        for(int p = 0; p < pieces; p++) {
+            size_t last = frames.size() * (p + 1) / pieces;
+            windows.emplace_back(frames.begin() + first, frames.begin() + last);
+            first = last;
+        }
+        dispatched += pieces;
+        if(pieces > 1)
+            splits++;
+        return windows;
+    }
+
+    /**
+     *  @name threads
+     *  @brief FFmpeg threads of an encoder about to start, in the tail of the job the cores
+     *  are shared by the encoders still running instead of all the workers
+     *  @return integer
+     *
+     */
+    int threads(int base) {
+        std::lock_guard<std::mutex> lock(mtx);
+        if(!enabled || !tail)
+            return base;
+        int running = max(1, dispatched - completed);
+        return max(base, min(cores / running, TAIL_MAX_THREADS));
+    }
+
+    void complete() {
+        std::lock_guard<std::mutex> lock(mtx);
+        completed++;
+    }
+
+    void print() {
+        std::lock_guard<std::mutex> lock(mtx);
+        if(splits == 0) return;
+        cout << " ****** Tail windows split between idle workers: " << splits << "\n";
+    }
+};
+
+TailBalancer tailBalancer;
@@ -18,6 +18,7 @@
 #include <cstdint>
 #include <thread>
 #include <iterator>
+#include <sstream>
 
 
 using namespace std;
@@ -29,6 +30,94 @@ passed in parameter.
 */
 typedef vector<string> stringVec;
 
+/**
+ *  @name Rendition
+ *  @brief one output of the rendition ladder: a target height and an optional bitrate
+ *
+ */
+struct Rendition {
+    int height;
+    string bitrate;
+
+    string name() const { return to_string(height) + "p"; }
+};
+
+/**
+ *  @name ConverterOptions
+ *  @brief optional settings of the parallel converter, filled from the command line
+ *
+ */
+struct ConverterOptions {
+    // how frames reach the encoders: "files" lets ffmpeg open the images, "pipe" splices them to its stdin
+    string transport = "files";
+    // capacity in MB of the frame ring (pipe buffer) between a worker and its encoder
+    int ringSizeMB = 1;
+    // outputs produced from a single decode of every window, empty for a single output
+    vector<Rendition> renditions;
+    // height of the preview track encoded ahead of the master, 0 disables it
+    int proxyHeight = 0;
+    // frame rate cap of the preview track, 0 keeps the input frame rate
+    int proxyFps = 0;
+    // collapse runs of identical frames into a single variable duration frame
+    bool dedup = false;
+    // directory of the content addressed segment cache, empty disables it
+    string cacheDir;
+    // size bound of the segment cache in MB
+    int cacheSizeMB = 10240;
+    // snap window boundaries to the nearest scene cut
+    bool sceneCuts = false;
+    // max distance in frames between a nominal boundary and the scene cut replacing it
+    int sceneTolerance = 12;
+    // histogram distance above which two consecutive frames are a scene cut
+    double sceneThreshold = 0.3;
+    // size windows by estimated encode cost instead of frame count
+    bool costWindows = false;
+    // one frame out of costSample is analysed by the cost estimator
+    int costSample = 8;
+    // size in MB of the output: analysis pass, budget split by complexity, parallel second pass
+    int targetSizeMB = 0;
+    // seconds from the start until the job has to be delivered, selects the preset per window
+    int deadlineSec = 0;
+    // projected duration, relative to the median window, that starts a speculative duplicate; 0 disables it
+    double speculateFactor = 0.0;
+    // split the last windows between the idle workers
+    bool tailSplit = false;
+    // threads shared by all the ffmpeg processes of the job, 0 for the cores, -1 unbounded
+    int cpuBudget = -1;
+    // workers and their encoders on the cores and memory of one NUMA node, the emitter apart
+    bool placement = false;
+    // csv file collecting the throughput of the jobs, with and without placement
+    string placementReport;
+    // share the machine with other workloads: idle priority, encoder threads driven by cpu pressure
+    bool background = false;
+    // memory in MB that the running encoders may reach together, 0 unbounded
+    long memBudgetMB = 0;
+    // journal the completed windows in the tmp directory and reuse them when the job is run again
+    bool resume = false;
+    // encodes of a failed window, and merges, run again before the job fails
+    int retries = 2;
+    // endpoints of the encoder nodes, the windows of worker w go to node w modulo their number
+    stringVec nodes;
+    // send the frames to the encoder nodes instead of reading them from shared storage
+    bool shipFrames = false;
+    // manifest of the frame ranges rendered by every node, their windows are encoded there
+    string localityManifest;
+    // fragmented MP4 windows published in HLS and DASH manifests, no merge
+    bool cmaf = false;
+    // frames between the keyframes of the fragments, 0 for two seconds
+    int cmafGop = 0;
+    // live MPEG-TS stream in window order: - for stdout, a FIFO or file, tcp:// or ipc:// to listen on
+    string liveTarget;
+    // MB of windows held in memory while an earlier one is missing, the later ones wait on disk
+    long liveBufferMB = 256;
+    // tmp directory of the job, removed once it completes
+    string tmpDir = "./tmp/";
+    // directory of the outputs
+    string outputDir = "./output/";
+    // MB of segments kept in memory (tmpfs) until the merge, 0 for the tmp directory only
+    long tmpRamMB = 0;
+};
+
 regex base_regex("^(.(.*\\.png$|.*\\.jpg$|.*\\.jpeg$|.*\\.JPEG$|.*\\.JPG$|.*\\.gif$|.*\\.svg))*$");
 smatch base_match;
 
@@ -45,6 +134,9 @@ void read_directory(const string& name, stringVec& v, int tot_frames){
     int i=0;
     DIR* dirp = opendir(name.c_str());
     struct dirent * dp;
+    // a directory not created yet has no frame
+    if(dirp == NULL)
+        return;
 
     while ((dp = readdir(dirp)) != NULL) {
         if (regex_match (dp->d_name, base_regex )) {
@@ -96,6 +188,86 @@ char* getCmdOption(char ** begin, char ** end, const string & option) {
     return 0;
 }
 
+/**
+*  @name frameFilename
+*  @brief Expand a printf-like image pattern (e.g. frame_%04d.png) with a frame index,
+*  the same way ffmpeg's image2 demuxer does
+* @return string
+*
+*/
+string frameFilename(const string &pattern, int index) {
+    string::size_type p = pattern.find('%');
+    if(p == string::npos)
+        return pattern;
+
+    string::size_type q = p + 1;
+    bool zeroPad = q < pattern.size() && pattern[q] == '0';
+    int width = 0;
+    while(q < pattern.size() && isdigit(pattern[q])) {
+        width = width * 10 + (pattern[q] - '0');
+        q++;
+    }
+    if(q >= pattern.size() || pattern[q] != 'd')
+        return pattern;
+
+    string number = to_string(index);
+    if(int(number.size()) < width)
+        number.insert(0, width - number.size(), zeroPad ? '0' : ' ');
+
+    return pattern.substr(0, p) + number + pattern.substr(q + 1);
+}
+
+/**
+*  @name parseRenditions
+*  @brief Parse a rendition ladder like "2160,1080:5M,720:2500k" (height[:bitrate],...)
+* @return vector of Rendition
+*
+*/
+vector<Rendition> parseRenditions(const string &spec) {
+    vector<Rendition> renditions;
+    stringstream ss(spec);
+    string item;
+
+    while(getline(ss, item, ',')) {
+        if(item.empty()) continue;
+        Rendition r;
+        string::size_type p = item.find(':');
+        r.height = atoi(item.substr(0, p).c_str());
+        if(p != string::npos)
+            r.bitrate = item.substr(p + 1);
+        if(r.height > 0)
+            renditions.push_back(r);
+    }
+
+    return renditions;
+}
+
+/**
+*  @name renditionFilename
+*  @brief Add the rendition name before the extension of a filename, e.g. out.mp4 -> out_1080p.mp4
+* @return string
+*
+*/
+string renditionFilename(const string &filename, const Rendition &r) {
+    string::size_type p = filename.rfind('.');
+    if(p == string::npos)
+        return filename + "_" + r.name();
+    return filename.substr(0, p) + "_" + r.name() + filename.substr(p);
+}
+
+/**
+*  @name windowTag
+*  @brief zero padded first frame of a window, partial outputs named with it sort in frame order
+* @return string
+*
+*/
+string windowTag(int firstFrame) {
+    string tag = to_string(firstFrame);
+    if(tag.size() < 8)
+        tag.insert(0, 8 - tag.size(), '0');
+    return tag;
+}
+
 /**
 *  @name getCmdOption
 *  @brief Add auto end slash to dir names
@@ -124,11 +296,51 @@ void input_helper(const char* arg) {
     cerr << "outputfilename:\t path and name of the final output file and it's format." << endl;
     cerr << "--tot_frames:\t total number of input images to process." << endl;
     cerr << "--seq:\t\t sequential version" << endl;
-    cerr << "--par:\t\t parallel version. Specify n workers." << endl;
+    cerr << "--par:\t\t parallel version. Specify n workers, or auto to take them from the machine profile." << endl;
     cerr << "--ffmpeg_thds:\t [Optional] number of threads for ffmpeg to use, defautls[seq =1 , par= auto calculate]." << endl;
     cerr << "--re_encode:\t [Optional] add this option to enable re-encoding. Better compression but much processing time." << endl;
     cerr << "--audio:\t [Optional] path and filename with it's format of the audio file." << endl;
     cerr << "--framerate:\t [Optional] output file encoding framerate." << endl;
+    cerr << "--transport:\t [Optional] files | pipe. pipe splices the frames into the encoders stdin through a bounded ring." << endl;
+    cerr << "--ring_mb:\t [Optional] size in MB of the pipe ring used by --transport pipe." << endl;
+    cerr << "--renditions:\t [Optional] comma separated ladder height[:bitrate], e.g. 2160,1080:5M,720. Each window is decoded once for all of them." << endl;
+    cerr << "--proxy:\t [Optional] height of a fast preview (ultrafast MPEG-TS) built progressively while the master encodes." << endl;
+    cerr << "--proxy_fps:\t [Optional] frame rate cap of the preview." << endl;
+    cerr << "--dedup:\t [Optional] skip encoding of repeated (held) frames, keeping their timing with variable frame rate." << endl;
+    cerr << "--cache_dir:\t [Optional] directory of a segment cache; windows with unchanged frames reuse their encoded segment." << endl;
+    cerr << "--cache_mb:\t [Optional] size bound of the segment cache in MB, least recently used segments are evicted." << endl;
+    cerr << "--scene_cuts:\t [Optional] move window boundaries to the nearest scene cut, so that every chunk starts on a natural keyframe." << endl;
+    cerr << "--scene_tolerance:\t [Optional] max distance in frames of the scene cut from the nominal boundary." << endl;
+    cerr << "--scene_threshold:\t [Optional] luma histogram distance (0-1) detecting a scene cut." << endl;
+    cerr << "--cost_windows:\t [Optional] size windows by estimated encode cost (frame complexity), refined with the measured encode times." << endl;
+    cerr << "--cost_sample:\t [Optional] analyse one frame every n for the cost estimate." << endl;
+    cerr << "--target_size:\t [Optional] output size in MB. A parallel analysis pass splits the bitrate budget across the windows, then a parallel second pass encodes them." << endl;
+    cerr << "--deadline:\t [Optional] seconds to complete the job. Every window gets the slowest x264 preset that still meets it." << endl;
+    cerr << "--speculate:\t [Optional] encode again a window projected to take this many times the median of the others, once workers are idle (e.g. 2)." << endl;
+    cerr << "--tail_split:\t [Optional] split the last windows between the idle workers and give the last encoders the threads of the idle ones." << endl;
+    cerr << "--cpu_budget:\t [Optional] threads shared by all the encoders, merges and mux of the job (0 for the number of cores); later windows get the threads freed." << endl;
+    cerr << "--placement:\t [Optional] bind every worker and its encoders to cores and memory of one NUMA node, the emitter to a core of its own." << endl;
+    cerr << "--placement_report:\t [Optional] csv file collecting the throughput of every job, compared with and without --placement." << endl;
+    cerr << "--background:\t [Optional] co-location with other workloads: encoders at SCHED_IDLE/nice 19, their threads grow and shrink with /proc/pressure/cpu." << endl;
+    cerr << "--mem_budget:\t [Optional] memory in MB for the running encoders; a window waits until the estimated peak of its encoder fits." << endl;
+    cerr << "--resume:\t [Optional] journal the completed windows; run the same job again after a crash to encode only the windows that did not complete." << endl;
+    cerr << "--retries:\t [Optional] times a window whose ffmpeg failed, or left a broken segment, is encoded again before the job fails (default 2)." << endl;
+    cerr << "--nodes:\t [Optional] comma separated encoder nodes, tcp://host:port or ipc:///path. The windows of every worker are encoded by one of them and their segments sent back." << endl;
+    cerr << "--ship_frames:\t [Optional] send the frames with every window instead of having the encoder nodes read them from shared storage." << endl;
+    cerr << "--locality:\t [Optional] manifest of the render nodes, one 'first last endpoint pattern' line per frame range. Windows are cut at the ranges and encoded by the encoder node holding their frames; the watched folder only needs the frame files, or empty markers." << endl;
+    cerr << "--cmaf:\t [Optional] streaming output in ./output/<name>_cmaf: every window is a fragmented MP4 (one per rendition), published in index.m3u8 and manifest.mpd as soon as the windows before it are, playable during the render. No merge, the audio is not packaged." << endl;
+    cerr << "--cmaf_gop:\t [Optional] frames between the keyframes of the fragments, the same in every rendition (default two seconds)." << endl;
+    cerr << "--live:\t [Optional] stream the job as MPEG-TS in window order while it renders: - for stdout (the logs go to stderr), a FIFO, or tcp://host:port / ipc:///path to serve a viewer. Windows are dropped while no viewer is connected." << endl;
+    cerr << "--live_buffer:\t [Optional] MB of windows held in memory while an earlier window is missing (default 256); the later ones wait on disk." << endl;
+    cerr << "--tmp_dir:\t [Optional] directory for the partial outputs, the job uses an iol_<name> directory of its own in it (default ./tmp)." << endl;
+    cerr << "--output_dir:\t [Optional] directory of the outputs (default ./output)." << endl;
+    cerr << "--tmp_ram:\t [Optional] MB of segments kept in memory (/dev/shm) until the merge, the others go to the tmp directory. Keep it below the free space of /dev/shm." << endl;
+    cerr << "--calibrate:\t run sample encodes of the frames already in the input folder over a grid of workers and ffmpeg threads, and save the machine profile." << endl;
+    cerr << "--profile:\t [Optional] file of the machine profiles (default ~/.iol_machine_profiles). The profile sets --ffmpeg_thds when omitted, and the workers with --par auto." << endl;
+    cerr << "--daemon:\t " << arg << " --daemon socket [--jobs n] [--cpu_budget n] [--state_dir dir]: accept jobs on a Unix socket, n at a time, sharing the cpu tokens." << endl;
+    cerr << "--submit:\t " << arg << " --submit socket input_path inputFileNamePattern outputFilename [options] [--priority n] [--wait]: queue a job on a daemon." << endl;
+    cerr << "--status:\t " << arg << " --status socket [id]: state, priority, elapsed time, output and log of the jobs of a daemon." << endl;
+    cerr << "--encoder_node:\t " << arg << " --encoder_node endpoint [--slots n]: encode the windows of the coordinators using --nodes, n at a time." << endl;
     cerr << "--help:\t to show this help file." << endl;
     cerr << "---------------------------------------------------------" << endl;
 